@@ -0,0 +1,426 @@
+// buffered & pipelined file i/o shared by encoder and decoder
+#ifndef BUFIO_H
+#define BUFIO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>      // sched_yield
+#include <stdatomic.h>
+#include <stdint.h>
+#include <errno.h>
+#include "crc32c.h"     // checksum of the bytes passing through
+#ifdef _WIN32
+#include <io.h>         // _setmode
+#include <fcntl.h>      // _O_BINARY
+#endif
+
+#define IO_BLOCK   (1 << 20)  // bytes per i/o block (1 MiB)
+#define RING_SIZE  4          // blocks in flight per pipe (power of 2)
+#ifndef SPOOL_MEM
+#define SPOOL_MEM  (64u << 20) // input copy kept in memory, the rest goes to a temp file
+#endif
+
+// one i/o block, len 0 marks end of stream
+typedef struct {
+    unsigned char *data;
+    size_t len;
+} Block;
+
+// ------------------ lock-free single-producer / single-consumer ring ------------------
+typedef struct {
+    Block *slot[RING_SIZE];
+    atomic_size_t head;   // next slot to pop (consumer side)
+    atomic_size_t tail;   // next slot to push (producer side)
+} Ring;
+
+static inline void ring_push(Ring *r, Block *b){
+    size_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    // ring full, wait for consumer
+    while (t - atomic_load_explicit(&r->head, memory_order_acquire) == RING_SIZE) sched_yield();
+    r->slot[t & (RING_SIZE - 1)] = b;
+    atomic_store_explicit(&r->tail, t + 1, memory_order_release); // publish block
+}
+static inline Block* ring_pop(Ring *r){
+    size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    // ring empty, wait for producer
+    while (atomic_load_explicit(&r->tail, memory_order_acquire) == h) sched_yield();
+    Block *b = r->slot[h & (RING_SIZE - 1)];
+    atomic_store_explicit(&r->head, h + 1, memory_order_release); // release slot
+    return b;
+}
+
+// ------------------ pipe: worker thread + two rings ------------------
+// full: blocks with data going one way, free: empty blocks coming back
+typedef struct {
+    FILE *fp;
+    Ring full, free;
+    Block blk[RING_SIZE];
+    pthread_t tid;
+    int err;              // errno of a failed read (reader) or of a block that didn't get written (writer)
+} Pipe;
+
+static inline Pipe* pipe_create(FILE *fp){
+    Pipe *p = (Pipe*)calloc(1, sizeof(Pipe));
+    if (p == NULL) return NULL;
+    p->fp = fp;
+    for (int i = 0; i < RING_SIZE; i++) {
+        p->blk[i].data = (unsigned char*)malloc(IO_BLOCK);
+        if (p->blk[i].data == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    }
+    return p;
+}
+static inline void pipe_free(Pipe *p){
+    for (int i = 0; i < RING_SIZE; i++) free(p->blk[i].data);
+    free(p);
+}
+
+// reader thread: fill free blocks from file, hand them over as full
+static void* reader_main(void *arg){
+    Pipe *p = (Pipe*)arg;
+    for (;;) {
+        Block *b = ring_pop(&p->free);
+        b->len = fread(b->data, 1, IO_BLOCK, p->fp);
+        if (b->len < IO_BLOCK && ferror(p->fp)) p->err = errno ? errno : EIO; // seen with the end block
+        ring_push(&p->full, b);
+        if (b->len == 0) break; // end of file sent
+        if (p->err) { // bytes before the error go first, then the end block
+            b = ring_pop(&p->free);
+            b->len = 0;
+            ring_push(&p->full, b);
+            break;
+        }
+    }
+    return NULL;
+}
+// writer thread: drain full blocks to file, give them back as free
+static void* writer_main(void *arg){
+    Pipe *p = (Pipe*)arg;
+    for (;;) {
+        Block *b = ring_pop(&p->full);
+        if (b->len == 0) break; // end of stream
+        if (!p->err && fwrite(b->data, 1, b->len, p->fp) != b->len) p->err = errno ? errno : EIO; // keep draining
+        ring_push(&p->free, b);
+    }
+    return NULL;
+}
+
+// ------------------ open file or "-" for stdin / stdout ------------------
+static inline FILE* open_stream(const char *fn, const char *mode){
+    if (strcmp(fn, "-") != 0) return fopen(fn, mode);
+    FILE *fp = (mode[0] == 'r') ? stdin : stdout;
+#ifdef _WIN32
+    _setmode(_fileno(fp), _O_BINARY); // no \n -> \r\n translation
+#endif
+    return fp;
+}
+
+// ------------------ input stream ------------------
+typedef struct {
+    FILE *fp;
+    unsigned char *buf;    // current block
+    size_t pos, len;       // read position, valid bytes
+    unsigned char back[4]; // pushed back bytes (like ungetc)
+    int nback;
+    int eof;
+    int err;               // errno of a failed read, input ends there (consumer checks it)
+    Pipe *pipe;            // reader thread, NULL when synchronous
+    Block *cur;            // block owned by consumer (pipeline mode)
+    unsigned char *mem;    // block of synchronous mode
+    unsigned char *spool;  // copy of everything read (input can't seek), at most SPOOL_MEM
+    size_t spool_len, spool_cap;
+    FILE *spool_fp;        // copy past SPOOL_MEM: unlinked tmpfile(), holds all of it
+    int spool_on;          // 1 = copying blocks into spool
+    int spooled;           // 1 = replaying spool from memory
+    int crc_on;            // 1 = crc of every block read
+    uint32_t crc;
+    unsigned long long nread; // bytes read since open / rewind
+} InStream;
+
+static inline void in_start(InStream *s){
+    s->pos = s->len = 0;
+    s->nread = 0;
+    s->nback = 0;
+    s->eof = 0;
+    if (s->pipe) {
+        s->cur = NULL;
+        for (int i = 0; i < RING_SIZE; i++) ring_push(&s->pipe->free, &s->pipe->blk[i]);
+        pthread_create(&s->pipe->tid, NULL, reader_main, s->pipe);
+    }
+}
+// pipelined: 1 = read with a separate reader thread
+static inline void in_open(InStream *s, FILE *fp, int pipelined){
+    memset(s, 0, sizeof(*s));
+    s->fp = fp;
+    if (pipelined) s->pipe = pipe_create(fp);
+    if (s->pipe == NULL) s->buf = s->mem = (unsigned char*)malloc(IO_BLOCK);
+    in_start(s);
+}
+// allow in_rewind() on pipes / stdin: keep a copy of the input, in memory up to
+// SPOOL_MEM, then in an unlinked temp file (TMPDIR needs room for the whole input)
+static inline void in_keep(InStream *s){
+    if (fseek(s->fp, 0, SEEK_CUR) != 0) s->spool_on = 1; // not seekable
+}
+// get next block, return 0 at end of file
+static inline int in_refill(InStream *s){
+    if (s->eof) return 0;
+    if (s->spooled) {
+        s->len = 0; // whole input was in memory
+    } else if (s->pipe) {
+        if (s->cur) ring_push(&s->pipe->free, s->cur); // hand back consumed block
+        s->cur = ring_pop(&s->pipe->full);
+        s->buf = s->cur->data;
+        s->len = s->cur->len;
+        if (s->len == 0 && s->pipe->err && !s->err) s->err = s->pipe->err;
+    } else {
+        s->len = s->err ? 0 : fread(s->buf, 1, IO_BLOCK, s->fp);
+        if (s->len < IO_BLOCK && ferror(s->fp) && !s->err) s->err = errno ? errno : EIO;
+    }
+    s->pos = 0;
+    if (s->len == 0) { s->eof = 1; return 0; }
+    s->nread += s->len;
+    if (s->crc_on) s->crc = crc32c(s->crc, s->buf, s->len);
+    if (s->spool_on && (s->spool_fp || s->spool_len + s->len > SPOOL_MEM)) { // copy too big for memory
+        if (s->spool_fp == NULL) { // move what is in memory to a temp file first
+            s->spool_fp = tmpfile();
+            if (s->spool_fp == NULL || fwrite(s->spool, 1, s->spool_len, s->spool_fp) != s->spool_len) {
+                perror("spool input to temp file");
+                exit(1);
+            }
+            free(s->spool);
+            s->spool = NULL;
+            s->spool_len = s->spool_cap = 0;
+        }
+        if (fwrite(s->buf, 1, s->len, s->spool_fp) != s->len) { perror("spool input to temp file"); exit(1); }
+    } else if (s->spool_on) { // keep a copy for the next pass
+        if (s->spool_len + s->len > s->spool_cap) {
+            size_t cap = s->spool_cap ? s->spool_cap : IO_BLOCK;
+            while (cap < s->spool_len + s->len) cap *= 2;
+            s->spool = (unsigned char*)realloc(s->spool, cap);
+            if (s->spool == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+            s->spool_cap = cap;
+        }
+        memcpy(s->spool + s->spool_len, s->buf, s->len);
+        s->spool_len += s->len;
+    }
+    return 1;
+}
+static inline int in_getc(InStream *s){
+    if (s->nback > 0) return s->back[--s->nback];
+    if (s->pos == s->len && !in_refill(s)) return EOF;
+    return s->buf[s->pos++];
+}
+static inline void in_ungetc(InStream *s, int c){
+    s->back[s->nback++] = (unsigned char)c;
+}
+// wait for reader thread to reach end of file and exit
+static inline void in_stop(InStream *s){
+    if (s->pipe == NULL) return;
+    while (in_refill(s)) ; // drain till end block
+    pthread_join(s->pipe->tid, NULL);
+    s->pipe->full.head = s->pipe->full.tail = 0;
+    s->pipe->free.head = s->pipe->free.tail = 0;
+}
+// restart from beginning of file (next pass)
+static inline void in_rewind(InStream *s){
+    in_stop(s);
+    if (s->spool_on) while (in_refill(s)) ; // pass stopped early: copy the rest too
+    if (s->spool_on && s->spool_fp) { // read the temp file from now on, it seeks
+        int pipelined = s->pipe != NULL;
+        if (s->pipe) pipe_free(s->pipe);
+        s->pipe = NULL;
+        s->spool_on = 0;
+        s->fp = s->spool_fp;
+        if (fflush(s->fp) != 0) { perror("spool input to temp file"); exit(1); }
+        if (pipelined) s->pipe = pipe_create(s->fp);
+        if (s->pipe == NULL && s->mem == NULL) s->mem = (unsigned char*)malloc(IO_BLOCK);
+        if (s->pipe == NULL) s->buf = s->mem;
+    }
+    if (s->spool_on || s->spooled) { // replay the copy instead of seeking
+        if (s->pipe) pipe_free(s->pipe);
+        s->pipe = NULL;
+        s->spool_on = 0;
+        s->spooled = 1;
+        s->buf = s->spool;
+        s->len = s->nread = s->spool_len;
+        s->pos = 0;
+        s->nback = 0;
+        s->eof = 0;
+        return;
+    }
+    rewind(s->fp);
+    in_start(s);
+}
+// crc of the bytes read from here on (bytes still in the block too)
+static inline void in_crc_start(InStream *s){
+    s->crc_on = 1;
+    s->crc = crc32c(0, s->buf + s->pos, s->len - s->pos);
+}
+// jump to byte offset, input without reader thread only
+static inline int in_seek(InStream *s, long long off){
+    if (s->pipe || fseeko(s->fp, (off_t)off, SEEK_SET) != 0) return 0;
+    s->pos = s->len = 0;
+    s->nback = 0;
+    s->eof = 0;
+    return 1;
+}
+static inline void in_close(InStream *s){
+    in_stop(s);
+    if (s->pipe) pipe_free(s->pipe);
+    free(s->mem);
+    free(s->spool);
+    if (s->spool_fp) fclose(s->spool_fp);
+    s->spool_fp = NULL;
+    s->pipe = NULL;
+    s->buf = s->mem = s->spool = NULL;
+}
+// read n bytes, return number of bytes read
+static inline size_t in_read(InStream *s, void *p, size_t n){
+    unsigned char *dst = (unsigned char*)p;
+    size_t got = 0;
+    while (got < n && s->nback > 0) dst[got++] = s->back[--s->nback];
+    while (got < n) {
+        if (s->pos == s->len && !in_refill(s)) break;
+        size_t k = s->len - s->pos;
+        if (k > n - got) k = n - got;
+        memcpy(dst + got, s->buf + s->pos, k);
+        s->pos += k;
+        got += k;
+    }
+    return got;
+}
+// read little-endian integer of nbytes, return 0 at end of file
+static inline int in_get_le(InStream *s, int nbytes, uint64_t *v){
+    unsigned char b[8];
+    if (in_read(s, b, nbytes) != (size_t)nbytes) return 0;
+    *v = 0;
+    for (int i = nbytes - 1; i >= 0; i--) *v = (*v << 8) | b[i];
+    return 1;
+}
+
+// ------------------ output stream ------------------
+typedef struct {
+    FILE *fp;
+    unsigned char *buf;  // current block
+    size_t len;          // bytes in block
+    Pipe *pipe;          // writer thread, NULL when synchronous
+    Block *cur;          // block owned by producer (pipeline mode)
+    int crc_on;          // 1 = crc of the bytes written since crc_at
+    size_t crc_at;
+    uint32_t crc;
+    int err;             // errno of a failed write, out_close() reports it
+} OutStream;
+
+// pipelined: 1 = write with a separate writer thread
+static inline void out_open(OutStream *s, FILE *fp, int pipelined){
+    memset(s, 0, sizeof(*s));
+    s->fp = fp;
+    if (pipelined) s->pipe = pipe_create(fp);
+    if (s->pipe) {
+        for (int i = 1; i < RING_SIZE; i++) ring_push(&s->pipe->free, &s->pipe->blk[i]);
+        s->cur = &s->pipe->blk[0];
+        s->buf = s->cur->data;
+        pthread_create(&s->pipe->tid, NULL, writer_main, s->pipe);
+    } else {
+        s->buf = (unsigned char*)malloc(IO_BLOCK);
+    }
+}
+// send current block to file
+static inline void out_flush(OutStream *s){
+    if (s->len == 0) return;
+    if (s->crc_on) {
+        s->crc = crc32c(s->crc, s->buf + s->crc_at, s->len - s->crc_at);
+        s->crc_at = 0;
+    }
+    if (s->pipe) {
+        s->cur->len = s->len;
+        ring_push(&s->pipe->full, s->cur); // writer thread takes it
+        s->cur = ring_pop(&s->pipe->free);
+        s->buf = s->cur->data;
+    } else if (!s->err && fwrite(s->buf, 1, s->len, s->fp) != s->len) {
+        s->err = errno ? errno : EIO;
+    }
+    s->len = 0;
+}
+static inline void out_putc(OutStream *s, int c){
+    if (s->len == IO_BLOCK) out_flush(s);
+    s->buf[s->len++] = (unsigned char)c;
+}
+static inline void out_write(OutStream *s, const void *p, size_t n){
+    const unsigned char *src = (const unsigned char*)p;
+    while (n > 0) {
+        if (s->len == IO_BLOCK) out_flush(s);
+        size_t k = IO_BLOCK - s->len;
+        if (k > n) k = n;
+        memcpy(s->buf + s->len, src, k);
+        s->len += k;
+        src += k;
+        n -= k;
+    }
+}
+// write p (n bytes) count times, copy doubling inside the block
+static inline void out_repeat(OutStream *s, const void *p, size_t n, unsigned long long count){
+    if (n == 1) { // one byte: memset
+        while (count > 0) {
+            if (s->len == IO_BLOCK) out_flush(s);
+            size_t k = IO_BLOCK - s->len;
+            if (k > count) k = (size_t)count;
+            memset(s->buf + s->len, *(const unsigned char*)p, k);
+            s->len += k;
+            count -= k;
+        }
+        return;
+    }
+    while (count > 0) {
+        if (IO_BLOCK - s->len < n) out_flush(s);
+        unsigned char *start = s->buf + s->len;
+        size_t room = (IO_BLOCK - s->len) / n; // copies fitting in block
+        if (room > count) room = (size_t)count;
+        memcpy(start, p, n);
+        size_t done = 1;
+        while (done < room) { // double filled part
+            size_t k = (done * 2 <= room) ? done : room - done;
+            memcpy(start + done * n, start, k * n);
+            done += k;
+        }
+        s->len += room * n;
+        count -= room;
+    }
+}
+// crc of the bytes written from here on
+static inline void out_crc_start(OutStream *s){
+    s->crc_on = 1;
+    s->crc = 0;
+    s->crc_at = s->len;
+}
+// stop, return crc since out_crc_start
+static inline uint32_t out_crc_end(OutStream *s){
+    s->crc = crc32c(s->crc, s->buf + s->crc_at, s->len - s->crc_at);
+    s->crc_on = 0;
+    return s->crc;
+}
+// write little-endian integer of nbytes
+static inline void out_put_le(OutStream *s, uint64_t v, int nbytes){
+    for (int i = 0; i < nbytes; i++) { out_putc(s, (int)(v & 0xFF)); v >>= 8; }
+}
+// flush everything, return 0 = ok, -1 = some bytes didn't reach the file (errno set, the FILE stays open)
+static inline int out_close(OutStream *s){
+    out_flush(s);
+    if (s->pipe) {
+        s->cur->len = 0; // end of stream
+        ring_push(&s->pipe->full, s->cur);
+        pthread_join(s->pipe->tid, NULL);
+        if (s->pipe->err && !s->err) s->err = s->pipe->err;
+        pipe_free(s->pipe);
+    } else {
+        free(s->buf);
+    }
+    s->pipe = NULL;
+    s->buf = NULL;
+    if ((fflush(s->fp) != 0 || ferror(s->fp)) && !s->err) s->err = errno ? errno : EIO;
+    if (s->err) errno = s->err;
+    return s->err ? -1 : 0;
+}
+
+#endif
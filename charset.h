@@ -0,0 +1,50 @@
+// symbol boundaries of ascii / utf-8 / big-5 text, shared by the encoder and the
+// push-style stream encoder (stream.h)
+#ifndef CHARSET_H
+#define CHARSET_H
+
+//------------------ utf-8 decoding ------------------
+static inline int utf8_len(unsigned char b0){  //use first byte to check UTF-8 using length
+    if ((b0 & 0x80)==0x00) return 1; //0xxxxxxx
+    if ((b0 & 0xE0)==0xC0) return 2; //110xxxxx
+    if ((b0 & 0xF0)==0xE0) return 3; //1110xxxx
+    if ((b0 & 0xF8)==0xF0) return 4; //11110xxx
+    return 0;
+}
+static inline int is_utf8_follow(unsigned char b){ //check is UTF-8 follow byte legal (10xxxxxx)
+    return (b & 0xC0)==0x80; //10xxxxxx
+}
+
+//------------------ big-5 decoding ------------------
+static inline int big5_len(unsigned char b0){
+    if (b0 <= 0x7F) return 1;                 // first byte < 127 ->ASCII
+    if (b0 >= 0x81 && b0 <= 0xFE) return 2;   // first byte is big-5 high byte 0x81-0xFE
+    return 1;
+}
+static inline int is_big5_follow(unsigned char b1){
+    // big5 low byte 0x40-0x7E , 0xA1-0xFE
+    return ( (b1 >= 0x40 && b1 <= 0x7E) || (b1 >= 0xA1 && b1 <= 0xFE) ); //check is big-5 rule
+}
+
+// -------------- symbol length at p, 4 bytes readable (mixed rules) --------------
+static inline int scan_mixed(const unsigned char *p){
+    unsigned char b0 = p[0];
+    if (b0 <= 0x7F) return 1;
+    int uLen = utf8_len(b0);
+    if (uLen > 1) { // utf-8 first
+        int ok = 1;
+        for (int i = 1; i < uLen; i++) if (!is_utf8_follow(p[i])) { ok = 0; break; }
+        if (ok) return uLen;
+    }
+    if (big5_len(b0) == 2 && is_big5_follow(p[1])) return 2; // then big-5
+    return 1; // unknown one byte symbol
+}
+// -------------- bytes scan_mixed() looks at before it knows the length --------------
+// bytes after the end of input count as no follow byte
+static inline int scan_need(unsigned char b0){
+    if (b0 <= 0x7F) return 1;
+    int uLen = utf8_len(b0);
+    return uLen > 2 ? uLen : 2;
+}
+
+#endif
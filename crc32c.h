@@ -0,0 +1,91 @@
+// crc32c (castagnoli) of data blocks: sse4.2 / armv8 crc instructions when the
+// cpu has them, else 8 table lookups per 8 bytes
+// crc = crc32c(0, p, n) for one buffer, crc = crc32c(crc, next, m) continues it
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#define CRC32C_POLY  0x82F63B78u  // reflected polynomial
+
+static uint32_t crc32c_tab[8][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_init(void){
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (CRC32C_POLY & (0u - (c & 1)));
+        crc32c_tab[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++) {
+        for (int i = 0; i < 256; i++) crc32c_tab[t][i] = (crc32c_tab[t-1][i] >> 8) ^ crc32c_tab[0][crc32c_tab[t-1][i] & 0xFF];
+    }
+}
+
+// ------------------ table version (slicing by 8) ------------------
+static inline uint32_t crc32c_sw(uint32_t c, const unsigned char *p, size_t n){
+    pthread_once(&crc32c_once, crc32c_init);
+    while (n >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= c; // little-endian byte order assumed
+        c = crc32c_tab[7][lo & 0xFF] ^ crc32c_tab[6][(lo >> 8) & 0xFF] ^
+            crc32c_tab[5][(lo >> 16) & 0xFF] ^ crc32c_tab[4][lo >> 24] ^
+            crc32c_tab[3][hi & 0xFF] ^ crc32c_tab[2][(hi >> 8) & 0xFF] ^
+            crc32c_tab[1][(hi >> 16) & 0xFF] ^ crc32c_tab[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) c = (c >> 8) ^ crc32c_tab[0][(c ^ *p++) & 0xFF];
+    return c;
+}
+
+// ------------------ crc instructions, picked at run time ------------------
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HW 1
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t c, const unsigned char *p, size_t n){
+    uint64_t c64 = c;
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c64 = _mm_crc32_u64(c64, v);
+        p += 8;
+        n -= 8;
+    }
+    c = (uint32_t)c64;
+    while (n--) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+static inline int crc32c_has_hw(void){ return __builtin_cpu_supports("sse4.2"); }
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HW 1
+static uint32_t crc32c_hw(uint32_t c, const unsigned char *p, size_t n){
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __crc32cd(c, v);
+        p += 8;
+        n -= 8;
+    }
+    while (n--) c = __crc32cb(c, *p++);
+    return c;
+}
+static inline int crc32c_has_hw(void){ return 1; }
+#endif
+
+static inline uint32_t crc32c(uint32_t crc, const void *p, size_t n){
+    const unsigned char *b = (const unsigned char*)p;
+    uint32_t c = ~crc;
+#ifdef CRC32C_HW
+    if (crc32c_has_hw()) return ~crc32c_hw(c, b, n);
+#endif
+    return ~crc32c_sw(c, b, n);
+}
+
+#endif
@@ -0,0 +1,914 @@
+// huffman decoding shared by decoder and codec daemon:
+// codebook csv -> decode tables (Codebook), encoded bits -> symbols
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "bufio.h"  // buffered / pipelined i/o
+#include "frame.h"  // embedded codebook stream format
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>   // mapped table cache
+#include <sys/stat.h>
+#endif
+
+// max symbol length (UTF-8 or Big5 is 4, merged token 16)
+#define MAX_SYMB_LEN 16
+// most context tables (order-1 codebook)
+#define MAX_TABLES   64
+// context map slots (more than symbol types)
+#define CTX_SLOTS    8192
+// tree nodes of the first allocation, doubles as needed
+#define NODE_CHUNK   1024
+// largest tANS table (log2 of states)
+#define ANS_MAX_LOG  15
+// bits of the first code lookup, and of each lookup after it
+#define LOOK_ROOT_BITS 10
+#define LOOK_SUB_BITS  8
+
+// Node.is_leaf: kind of leaf, so decoding doesn't compare symbol names
+#define LEAF_SYM  1
+#define LEAF_EOF  2
+#define LEAF_RUN  3
+#define LEAF_ESC  4
+
+// huffman tree node structure
+// children are indices into Codebook.nodes (node 0 = none), so tables can be
+// saved and mapped back at any address
+typedef struct Node {
+    int32_t left;         // left child (bit 0)
+    int32_t right;        // right child (bit 1)
+    int32_t is_leaf;      // 0 = inner node, else LEAF_SYM / LEAF_EOF / LEAF_RUN / LEAF_ESC
+
+    unsigned char chr[MAX_SYMB_LEN]; // symbol bytes
+    int32_t useLen;       // symbol byte length
+    int32_t next;         // table for the symbol after this leaf (order-1)
+} Node;
+
+// context map: previous symbol -> table, symbols not listed use table 0
+typedef struct {
+    unsigned char chr[MAX_SYMB_LEN];
+    int len;          // symbol length, 0 = empty
+    int table;
+} CtxEntry;
+
+// tANS symbol (codebook line order) and decode table entry
+typedef struct {
+    unsigned char chr[MAX_SYMB_LEN];
+    int useLen;
+    int freq;             // normalized count, all sum to 1 << log
+} AnsSym;
+typedef struct {
+    uint16_t sym;         // symbol of this state
+    uint16_t nb;          // bits to read
+    uint32_t base;        // next state = base + bits
+} AnsEntry;
+
+// lookup table entry: the next len bits lead to node (a leaf if sub == 0), several
+// bits at a time instead of one node per bit
+typedef struct {
+    int32_t node;         // leaf, or inner node the sub table starts at, 0 = no code
+    uint8_t len;          // bits taken by this lookup
+    uint8_t sub;          // bits of the sub table, 0 = leaf
+    uint16_t pad;
+    int32_t next;         // sub table offset
+} LookEntry;
+
+// decode tables of one codebook
+typedef struct {
+    int roots[MAX_TABLES];   // context tables, a single codebook is table 0
+    int ntables;
+    int start;               // table of the first symbol
+    int lenroot;             // run length bucket tree ("#runlen" lines), leaf next = bucket
+    int build;               // table being built
+    CtxEntry *ctx;           // context map, only while building
+    Node *nodes;             // all nodes, [0] unused
+    int nnodes, cap;
+    void *map;               // nodes and tables are in this mapped file (table cache)
+    size_t map_len;
+    int ans_log;             // "#ans,log": tANS table of 1 << log states, 0 = huffman
+    int ans_n, ans_cap;
+    AnsSym *ans_sym;
+    AnsEntry *ans_tab;
+    int has_crc;             // "#crc32c,x": crc of the decoded bytes (separate codebook file)
+    uint32_t crc;
+    LookEntry *look;         // lookup tables of all context tables (huffman)
+    int nlook, look_cap;
+    int look_root[MAX_TABLES]; // root lookup of each table
+    int look_bits[MAX_TABLES]; // its bits, 0 = table is a single leaf
+} Codebook;
+
+// ------------------ tANS state spread, shared with the encoder -------------------------
+// symbol s takes freq[s] states, stepping through the table to mix symbols
+static inline void ans_spread(const int *freq, int n, int log, uint16_t *spread) {
+    int L = 1 << log, pos = 0;
+    int step = (L >> 1) + (L >> 3) + 3; // odd: visits every state once
+    for (int s = 0; s < n; s++) {
+        for (int i = 0; i < freq[s]; i++) {
+            spread[pos] = (uint16_t)s;
+            pos = (pos + step) & (L - 1);
+        }
+    }
+}
+static inline int floor_log2(uint32_t v) {
+    int r = 0;
+    while (v >>= 1) r++;
+    return r;
+}
+
+static inline CtxEntry* ctx_slot(CtxEntry *map, const unsigned char *chr, int len) {
+    uint64_t key = 14695981039346656037ull; // FNV-1a of symbol bytes
+    for (int i = 0; i < len; i++) key = (key ^ chr[i]) * 1099511628211ull;
+    size_t h = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 51); // 13 bits -> CTX_SLOTS
+    while (map[h].len != 0 && (map[h].len != len || memcmp(map[h].chr, chr, len) != 0)) h = (h + 1) & (CTX_SLOTS - 1);
+    return &map[h];
+}
+
+// ------------------ create a new node, return its index -------------------------
+static inline int create_node(Codebook *cb) {
+    if (cb->nnodes == cb->cap) { // node pointers move, keep indices while building
+        cb->cap = cb->cap ? 2 * cb->cap : NODE_CHUNK;
+        cb->nodes = (Node*)realloc(cb->nodes, cb->cap * sizeof(Node));
+        if (cb->nodes == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    }
+    memset(&cb->nodes[cb->nnodes], 0, sizeof(Node));
+    return cb->nnodes++;
+}
+
+// ------------------- insert code to huffman tree ------------------------
+//  root, code, chr(symbol), len(symbol length)
+static inline void insert_code(Codebook *cb, int root, const char *code, const unsigned char *chr, int len) {
+    int curr = root;
+    const char *p = code;
+
+    // follow the code path 0 or 1 until the end, then build the tree
+    while (*p != '\0') {
+        if (*p == '0') {
+            if (cb->nodes[curr].left == 0) {
+                int n = create_node(cb);
+                cb->nodes[curr].left = n;
+            }
+            curr = cb->nodes[curr].left;
+        } else if (*p == '1') {
+            if (cb->nodes[curr].right == 0) {
+                int n = create_node(cb);
+                cb->nodes[curr].right = n;
+            }
+            curr = cb->nodes[curr].right;
+        }
+        p++;
+    }
+
+    // go to leaf node, set symbol
+    Node *leaf = &cb->nodes[curr];
+    leaf->is_leaf = LEAF_SYM;
+    if (len == 3 && memcmp(chr, "EOF", 3) == 0) leaf->is_leaf = LEAF_EOF;
+    else if (len == 3 && memcmp(chr, "RUN", 3) == 0) leaf->is_leaf = LEAF_RUN;
+    else if (len == 3 && memcmp(chr, "ESC", 3) == 0) leaf->is_leaf = LEAF_ESC;
+    memcpy(leaf->chr, chr, len);
+    leaf->useLen = len;
+}
+
+// ------------------- csv symbol field to bytes ------------------------
+// raw_sym: quoted symbol field of rlen bytes (no strlen: symbols may hold zero bytes),
+// return symbol length. inside a field "" is ", \0 a zero byte and \\ a backslash
+static inline int parse_symbol(const char *raw_sym, int rlen, unsigned char *symbol) {
+    // 去除前後的引號 " "
+    if (rlen > 0 && raw_sym[0] == '"') { raw_sym++; rlen--; } // 跳過第一個引號
+    if (rlen > 0 && raw_sym[rlen-1] == '"') rlen--; // 去掉最後一個引號
+
+    // 4. 還原特殊字元 (與 Encoder 對應)
+    int symLen = 0;
+    if (rlen == 3 && memcmp(raw_sym, "EOF", 3) == 0) {
+        // 特殊標記 EOF
+        memcpy(symbol, "EOF", 3);
+        symLen = 3;
+    } else if (rlen == 2 && memcmp(raw_sym, "\\n", 2) == 0) {
+        symbol[0] = '\n'; symLen = 1;
+    } else if (rlen == 2 && memcmp(raw_sym, "\\r", 2) == 0) {
+        symbol[0] = '\r'; symLen = 1;
+    } else if (rlen == 2 && memcmp(raw_sym, "\\t", 2) == 0) {
+        symbol[0] = '\t'; symLen = 1;
+    } else if (rlen == 2 && memcmp(raw_sym, "\\\"", 2) == 0) { // \" -> "
+        symbol[0] = '\"'; symLen = 1;
+    } else {
+        // 一般字元，處理雙引號還原 (Unescape)
+        int i = 0, j = 0;
+        while (i < rlen && j < MAX_SYMB_LEN) {
+            // 如果遇到 "" 就變成 "
+            if (raw_sym[i] == '"' && i + 1 < rlen && raw_sym[i+1] == '"') {
+                symbol[j++] = '"';
+                i += 2;
+            } else if (raw_sym[i] == '\\' && i + 1 < rlen && (raw_sym[i+1] == '0' || raw_sym[i+1] == '\\')) {
+                symbol[j++] = raw_sym[i+1] == '0' ? '\0' : '\\';
+                i += 2;
+            } else {
+                symbol[j++] = (unsigned char)raw_sym[i++];
+            }
+        }
+        symLen = j;       // 更新正確長度
+    }
+    return symLen;
+}
+
+// ------------------- "#..." lines of order-1 codebook ------------------------
+// #tables,n  #start,t  #ctx,t,"sym"  #table,t (following lines go to table t)
+static inline void parse_directive(Codebook *cb, char *line, int len) {
+    int t = 0;
+    if (sscanf(line, "#tables,%d", &t) == 1) {
+        if (t < 1 || t > MAX_TABLES) return;
+        for (int i = cb->ntables; i < t; i++) cb->roots[i] = create_node(cb);
+        if (t > cb->ntables) cb->ntables = t;
+    } else if (sscanf(line, "#start,%d", &t) == 1) {
+        if (t >= 0 && t < cb->ntables) cb->start = t;
+    } else if (sscanf(line, "#crc32c,%x", &cb->crc) == 1) {
+        cb->has_crc = 1;
+    } else if (sscanf(line, "#ans,%d", &t) == 1) {
+        if (t >= 5 && t <= ANS_MAX_LOG) cb->ans_log = t;
+    } else if (strncmp(line, "#runlen", 7) == 0) {
+        if (cb->lenroot == 0) cb->lenroot = create_node(cb);
+        cb->build = cb->lenroot;
+    } else if (sscanf(line, "#table,%d", &t) == 1) {
+        if (t >= 0 && t < cb->ntables) cb->build = cb->roots[t];
+    } else if (sscanf(line, "#ctx,%d,", &t) == 1) {
+        char *raw_sym = strchr(line + 5, ',');
+        if (raw_sym == NULL || t < 0 || t >= cb->ntables) return;
+        unsigned char symbol[MAX_SYMB_LEN + 1] = {0};
+        int symLen = parse_symbol(raw_sym + 1, (int)(line + len - raw_sym - 1), symbol);
+        if (symLen == 0) return;
+        CtxEntry *e = ctx_slot(cb->ctx, symbol, symLen);
+        memcpy(e->chr, symbol, symLen);
+        e->len = symLen;
+        e->table = t;
+    }
+}
+
+// --------------------- build tree with codebook ------------------------
+// search codebook line backwards to parse fields
+// CSV : "Symbol",count,prob,code,info  (len bytes, the symbol may hold zero bytes)
+static inline void parse_and_build(Codebook *cb, char *line, int len) {
+    // remove newline characters
+    while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
+        line[--len] = '\0';
+    }
+    if (len == 0) return;
+    if (line[0] == '#') { parse_directive(cb, line, len); return; }
+
+    // find code and symbol fields by scanning backwards
+    // find last 4 commas, second last is code, fourth last is symbol
+    char *ptr = line + len - 1;
+    int comma_cnt = 0;
+    char *code_start = NULL;
+    char *symbol_end = NULL; // address of the end of symbol field
+
+    while (ptr >= line) {
+        if (*ptr == ',') {
+            comma_cnt++;
+            if (comma_cnt == 2) {
+                // code, at the second last comma
+                code_start = ptr + 1;
+                // 將這個逗號改成 \0，切斷 code 與後面的 info
+                // 注意：原本格式是 code,info。我們其實只需要 code 開頭
+                // 但為了取字串，我們在 code 的下一個逗號(倒數第1個)也切斷比較保險
+                // 這裡簡化處理：直接抓 code_start
+            }
+            else if (comma_cnt == 4) {
+                // 找到 Symbol 結束的位置 (在倒數第4個逗號之前)
+                symbol_end = ptr;
+                *symbol_end = '\0'; // 切斷！這裡之前就是 Symbol 字串
+                break;
+            }
+        }
+        ptr--;
+    }
+
+    // 簡單的錯誤檢查
+    if (comma_cnt < 4 || code_start == NULL) return;
+
+    // 處理 Code 欄位：可能後面還有逗號連著 info，需要切斷
+    // code_start 目前指向 "010101,12.34"，我們要切掉逗號
+    char *p = code_start;
+    while(*p){
+        if(*p == ',') { *p = '\0'; break; }
+        p++;
+    }
+
+    // 3. 處理 Symbol 欄位 (line 開頭到 symbol_end)
+    unsigned char symbol[MAX_SYMB_LEN + 1] = {0};
+    int symLen = parse_symbol(line, (int)(symbol_end - line), symbol);
+
+    if (cb->ans_log > 0) { // tANS: code field is the normalized count
+        if (cb->ans_n == cb->ans_cap) {
+            cb->ans_cap = cb->ans_cap ? 2 * cb->ans_cap : 256;
+            cb->ans_sym = (AnsSym*)realloc(cb->ans_sym, cb->ans_cap * sizeof(AnsSym));
+            if (cb->ans_sym == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+        }
+        AnsSym *s = &cb->ans_sym[cb->ans_n++];
+        memcpy(s->chr, symbol, MAX_SYMB_LEN);
+        s->useLen = symLen;
+        s->freq = atoi(code_start);
+        return;
+    }
+
+    // 5. 插入樹中
+    insert_code(cb, cb->build, code_start, symbol, symLen);
+}
+
+// ------------------ start a new codebook (one table) -------------------------
+static inline void cb_init(Codebook *cb) {
+    memset(cb, 0, sizeof(*cb));
+    cb->ctx = (CtxEntry*)calloc(CTX_SLOTS, sizeof(CtxEntry));
+    if (cb->ctx == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    cb->ntables = 1;
+    create_node(cb); // node 0: no child
+    cb->build = cb->roots[0] = create_node(cb);
+}
+
+// ------------------ codebook done: link leaves to next tables -------------------------
+static inline void link_tables(Codebook *cb, int idx) {
+    if (idx == 0) return;
+    Node *node = &cb->nodes[idx];
+    if (node->is_leaf) {
+        CtxEntry *e = ctx_slot(cb->ctx, node->chr, node->useLen);
+        node->next = (e->len != 0) ? e->table : 0;
+        return;
+    }
+    link_tables(cb, node->left);
+    link_tables(cb, node->right);
+}
+static inline void set_buckets(Codebook *cb, int idx) {
+    if (idx == 0) return;
+    Node *node = &cb->nodes[idx];
+    if (node->is_leaf) { node->next = atoi((char*)node->chr); return; } // "12" -> 12
+    set_buckets(cb, node->left);
+    set_buckets(cb, node->right);
+}
+// tANS decode table, ans_log = -1 if the counts don't fill the table
+static inline void ans_build(Codebook *cb) {
+    int L = 1 << cb->ans_log;
+    int *freq = (int*)malloc((cb->ans_n + 1) * sizeof(int));
+    int *next = (int*)malloc((cb->ans_n + 1) * sizeof(int));
+    uint16_t *spread = (uint16_t*)malloc(L * sizeof(uint16_t));
+    cb->ans_tab = (AnsEntry*)malloc(L * sizeof(AnsEntry));
+    if (!freq || !next || !spread || !cb->ans_tab) { fprintf(stderr, "out of memory\n"); exit(1); }
+    long long sum = 0;
+    for (int s = 0; s < cb->ans_n; s++) {
+        freq[s] = next[s] = cb->ans_sym[s].freq;
+        if (freq[s] < 1 || freq[s] > L) sum = -1 - (long long)L; // invalid
+        sum += freq[s];
+    }
+    if (sum != L || cb->ans_n > 65536) {
+        cb->ans_log = -1;
+    } else {
+        ans_spread(freq, cb->ans_n, cb->ans_log, spread);
+        for (int x = 0; x < L; x++) {
+            int s = spread[x];
+            uint32_t n = (uint32_t)next[s]++; // n in [freq, 2 freq)
+            int nb = cb->ans_log - floor_log2(n);
+            cb->ans_tab[x].sym = (uint16_t)s;
+            cb->ans_tab[x].nb = (uint16_t)nb;
+            cb->ans_tab[x].base = (n << nb) - (uint32_t)L;
+        }
+    }
+    free(freq); free(next); free(spread);
+}
+// ------------------ lookup tables of the trees -------------------------
+// code depth below idx, at most max
+static inline int tree_depth(const Codebook *cb, int idx, int max) {
+    if (idx == 0 || cb->nodes[idx].is_leaf || max == 0) return 0;
+    int l = tree_depth(cb, cb->nodes[idx].left, max - 1);
+    int r = tree_depth(cb, cb->nodes[idx].right, max - 1);
+    return 1 + (l > r ? l : r);
+}
+// table of bits bits for the subtree at idx, return its offset; entries that
+// are still inner nodes get a table of their own
+static inline int look_build(Codebook *cb, int idx, int bits) {
+    int at = cb->nlook, size = 1 << bits;
+    if (cb->nlook + size > cb->look_cap) {
+        while (cb->nlook + size > cb->look_cap) cb->look_cap = cb->look_cap ? 2 * cb->look_cap : 4096;
+        cb->look = (LookEntry*)realloc(cb->look, cb->look_cap * sizeof(LookEntry));
+        if (cb->look == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    }
+    cb->nlook += size;
+    for (int v = 0; v < size; v++) {
+        LookEntry e = { 0, 0, 0, 0, 0 }; // no code
+        int curr = idx, k = 0;
+        while (curr != 0 && !cb->nodes[curr].is_leaf && k < bits) {
+            curr = ((v >> (bits - 1 - k)) & 1) ? cb->nodes[curr].right : cb->nodes[curr].left;
+            k++;
+        }
+        if (curr != 0) {
+            e.node = curr;
+            e.len = (uint8_t)k;
+            if (!cb->nodes[curr].is_leaf) { // deeper: next lookup
+                e.sub = (uint8_t)tree_depth(cb, curr, LOOK_SUB_BITS);
+                e.next = look_build(cb, curr, e.sub);
+            }
+        }
+        cb->look[at + v] = e;
+    }
+    return at;
+}
+
+static inline void cb_finish(Codebook *cb) {
+    for (int t = 0; t < cb->ntables; t++) link_tables(cb, cb->roots[t]);
+    set_buckets(cb, cb->lenroot);
+    if (cb->ans_log > 0) ans_build(cb);
+    for (int t = 0; cb->ans_log == 0 && t < cb->ntables; t++) {
+        cb->look_bits[t] = tree_depth(cb, cb->roots[t], LOOK_ROOT_BITS);
+        if (cb->look_bits[t] > 0) cb->look_root[t] = look_build(cb, cb->roots[t], cb->look_bits[t]);
+    }
+    free(cb->ctx); // only needed for linking
+    cb->ctx = NULL;
+}
+
+// ------------------ free all trees of a codebook -------------------------
+static inline void cb_free(Codebook *cb) {
+    if (cb->map) { // tables in the mapped file
+#ifndef _WIN32
+        munmap(cb->map, cb->map_len);
+#endif
+    } else {
+        free(cb->nodes);
+        free(cb->ans_sym);
+        free(cb->ans_tab);
+        free(cb->look);
+    }
+    free(cb->ctx);
+    cb->ctx = NULL;
+    cb->nodes = NULL;
+    cb->ans_sym = NULL;
+    cb->ans_tab = NULL;
+    cb->look = NULL;
+    cb->map = NULL;
+}
+
+// ------------------ build tables from codebook text in memory -------------------------
+// text needs one spare byte after len (lines are cut in place)
+static inline void cb_from_text(Codebook *cb, char *text, size_t len) {
+    cb_init(cb);
+    char *line = text;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            text[i] = '\0'; // one csv line
+            parse_and_build(cb, line, (int)(text + i - line));
+            line = text + i + 1;
+        }
+    }
+    if (line < text + len) { // last line without newline
+        text[len] = '\0';
+        parse_and_build(cb, line, (int)(text + len - line));
+    }
+    cb_finish(cb);
+}
+
+// ================== compiled decode tables, cached by codebook text ==================
+// "<dir>/<fnv-1a of text>.hdt": TableHead, nodes, ans_sym, ans_tab, look. only indices
+// inside, so the file is used where it is mapped: no parsing, no table building
+#define TABLE_MAGIC  0x32544448u  // "HDT2"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t node_size;       // sizeof(Node), tables of other builds don't match
+    uint64_t text_len;        // codebook text length and crc32c (against fnv collisions)
+    uint32_t text_crc;
+    int32_t ntables, start, lenroot, nnodes;
+    int32_t ans_log, ans_n;
+    int32_t has_crc;
+    uint32_t crc;
+    int32_t roots[MAX_TABLES];
+    int32_t nlook;
+    int32_t look_root[MAX_TABLES], look_bits[MAX_TABLES];
+} TableHead;
+
+static inline uint64_t text_fnv(const char *s, size_t n) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+    return h;
+}
+
+#ifndef _WIN32
+// ------------------ every index of a mapped file in range, 0 = damaged -------------------------
+static inline int table_valid(const TableHead *h, size_t size) {
+    if (h->magic != TABLE_MAGIC || h->node_size != sizeof(Node) || h->ntables < 1 || h->ntables > MAX_TABLES
+        || h->start < 0 || h->start >= h->ntables || h->nnodes < 2 || h->nnodes > (1 << 24)
+        || h->lenroot < 0 || h->lenroot >= h->nnodes || h->ans_n < 0 || h->ans_n > 65536
+        || h->ans_log < 0 || h->ans_log > ANS_MAX_LOG || (h->ans_log > 0 && h->ans_n == 0)) return 0;
+    size_t L = h->ans_log > 0 ? (size_t)1 << h->ans_log : 0;
+    if (h->nlook < 0 || h->nlook > (1 << 26)
+        || size != sizeof(TableHead) + h->nnodes * sizeof(Node) + h->ans_n * sizeof(AnsSym) + L * sizeof(AnsEntry) + h->nlook * sizeof(LookEntry)) return 0;
+    for (int t = 0; t < MAX_TABLES; t++) {
+        if (h->roots[t] < 0 || h->roots[t] >= h->nnodes || (t < h->ntables && h->roots[t] == 0)) return 0;
+    }
+    const Node *nodes = (const Node*)(h + 1);
+    for (int i = 0; i < h->nnodes; i++) { // leaf next: table or run length bits, both < MAX_TABLES
+        const Node *n = &nodes[i];
+        if (n->left < 0 || n->left >= h->nnodes || n->right < 0 || n->right >= h->nnodes
+            || n->useLen < 0 || n->useLen > MAX_SYMB_LEN || n->next < 0 || n->next >= MAX_TABLES) return 0;
+    }
+    const AnsSym *sym = (const AnsSym*)(nodes + h->nnodes);
+    const AnsEntry *tab = (const AnsEntry*)(sym + h->ans_n);
+    for (int s = 0; s < h->ans_n; s++) if (sym[s].useLen < 0 || sym[s].useLen > MAX_SYMB_LEN) return 0;
+    for (size_t x = 0; x < L; x++) {
+        if (tab[x].sym >= h->ans_n || tab[x].nb > h->ans_log || tab[x].base + ((size_t)1 << tab[x].nb) > L) return 0;
+    }
+    for (int t = 0; t < MAX_TABLES; t++) {
+        if (h->look_bits[t] < 0 || h->look_bits[t] > LOOK_ROOT_BITS || h->look_root[t] < 0
+            || (h->look_bits[t] > 0 && (t >= h->ntables || h->look_root[t] > h->nlook - (1 << h->look_bits[t])))) return 0;
+    }
+    // lookups end at a node of the right kind, every sub table inside
+    const LookEntry *look = (const LookEntry*)(tab + L);
+    for (int i = 0; i < h->nlook; i++) {
+        const LookEntry *e = &look[i];
+        if (e->node < 0 || e->node >= h->nnodes || e->len > LOOK_ROOT_BITS || (e->node != 0 && e->len == 0)) return 0;
+        if (e->sub == 0 && e->node != 0 && !nodes[e->node].is_leaf) return 0;
+        if (e->sub > 0 && (e->sub > LOOK_SUB_BITS || e->node == 0 || nodes[e->node].is_leaf
+            || e->next < 0 || e->next > h->nlook - (1 << e->sub))) return 0;
+    }
+    return 1;
+}
+#endif
+
+// ------------------ map cached tables, return 0 if missing / other codebook -------------------------
+static inline int cb_load(Codebook *cb, const char *path, uint64_t text_len, uint32_t text_crc) {
+#ifdef _WIN32
+    return 0;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TableHead)) map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+    const TableHead *h = (const TableHead*)map;
+    if (h->text_len != text_len || h->text_crc != text_crc || !table_valid(h, (size_t)st.st_size)) {
+        munmap(map, (size_t)st.st_size);
+        return 0;
+    }
+    memset(cb, 0, sizeof(*cb));
+    memcpy(cb->roots, h->roots, sizeof(cb->roots));
+    cb->ntables = h->ntables;
+    cb->start = h->start;
+    cb->lenroot = h->lenroot;
+    cb->nnodes = cb->cap = h->nnodes;
+    cb->nodes = (Node*)(h + 1);
+    cb->ans_log = h->ans_log;
+    cb->ans_n = cb->ans_cap = h->ans_n;
+    cb->ans_sym = (AnsSym*)(cb->nodes + h->nnodes);
+    cb->ans_tab = (AnsEntry*)(cb->ans_sym + h->ans_n);
+    cb->look = (LookEntry*)(cb->ans_tab + (h->ans_log > 0 ? (size_t)1 << h->ans_log : 0));
+    cb->nlook = cb->look_cap = h->nlook;
+    memcpy(cb->look_root, h->look_root, sizeof(cb->look_root));
+    memcpy(cb->look_bits, h->look_bits, sizeof(cb->look_bits));
+    cb->has_crc = h->has_crc;
+    cb->crc = h->crc;
+    cb->map = map;
+    cb->map_len = (size_t)st.st_size;
+    return 1;
+#endif
+}
+
+// ------------------ write tables for later runs (temp file, then rename) -------------------------
+static inline void cb_save(const Codebook *cb, const char *path, uint64_t text_len, uint32_t text_crc) {
+#ifndef _WIN32
+    if (cb->ans_log < 0) return; // broken tANS counts, nothing to keep
+    TableHead h;
+    memset(&h, 0, sizeof(h));
+    h.magic = TABLE_MAGIC;
+    h.node_size = sizeof(Node);
+    h.text_len = text_len;
+    h.text_crc = text_crc;
+    h.ntables = cb->ntables;
+    h.start = cb->start;
+    h.lenroot = cb->lenroot;
+    h.nnodes = cb->nnodes;
+    h.ans_log = cb->ans_log;
+    h.ans_n = cb->ans_n;
+    h.has_crc = cb->has_crc;
+    h.crc = cb->crc;
+    memcpy(h.roots, cb->roots, sizeof(h.roots));
+    h.nlook = cb->nlook;
+    memcpy(h.look_root, cb->look_root, sizeof(h.look_root));
+    memcpy(h.look_bits, cb->look_bits, sizeof(h.look_bits));
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) return;
+    size_t L = cb->ans_log > 0 ? (size_t)1 << cb->ans_log : 0;
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1
+          && fwrite(cb->nodes, sizeof(Node), cb->nnodes, fp) == (size_t)cb->nnodes
+          && fwrite(cb->ans_sym, sizeof(AnsSym), cb->ans_n, fp) == (size_t)cb->ans_n
+          && fwrite(cb->ans_tab, sizeof(AnsEntry), L, fp) == L
+          && fwrite(cb->look, sizeof(LookEntry), cb->nlook, fp) == (size_t)cb->nlook;
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) remove(tmp);
+#endif
+}
+
+// ------------------ codebook text -> tables, through the cache in dir (NULL = no cache) -------------------------
+// text needs one spare byte after len, return 1 if the tables came from the cache
+static inline int cb_from_cache(Codebook *cb, const char *dir, char *text, size_t len) {
+    if (dir == NULL) { cb_from_text(cb, text, len); return 0; }
+    char path[4096];
+    uint32_t crc = crc32c(0, text, len);
+    snprintf(path, sizeof(path), "%s/%016llx.hdt", dir, (unsigned long long)text_fnv(text, len));
+    if (cb_load(cb, path, len, crc)) return 1;
+    cb_from_text(cb, text, len); // cuts text into lines
+    cb_save(cb, path, len, crc);
+    return 0;
+}
+
+// ------------------ bit reader over at most limit bytes -------------------------
+typedef struct {
+    InStream *in;
+    int byte, nbits;              // current byte, bits left in it
+    unsigned long long used, limit;
+} BitIn;
+
+static inline int get_bit(BitIn *br) {
+    if (br->nbits == 0) {
+        if (br->used >= br->limit || (br->byte = in_getc(br->in)) == EOF) return -1;
+        br->used++;
+        br->nbits = 8;
+    }
+    br->nbits--;
+    return (br->byte >> br->nbits) & 1; // 讀取 byte 中的每一個 bit (7 -> 0)
+}
+
+// ------------------ one code through the lookup tables of table t -------------------------
+// peeks at the next 8 bytes in the input block (nothing read past the code), return
+// the leaf, or the inner node where 64 bits ran out; NULL = fewer bytes left there,
+// walk the tree bit by bit instead
+static inline const Node* look_code(const Codebook *cb, int t, BitIn *br) {
+    InStream *in = br->in;
+    if (in->nback > 0 || in->len - in->pos < 8 || br->limit - br->used < 8) return NULL;
+    const unsigned char *p = in->buf + in->pos;
+    uint64_t acc = 0;
+    for (int i = 0; i < 8; i++) acc = (acc << 8) | p[i];
+    if (br->nbits > 0) acc = (acc >> br->nbits) | ((uint64_t)br->byte << (64 - br->nbits));
+    const LookEntry *look = cb->look;
+    const LookEntry *e = &look[cb->look_root[t] + (acc >> (64 - cb->look_bits[t]))];
+    int n = 0; // bits before e
+    while (e->sub && n + e->len + e->sub <= 64) {
+        n += e->len;
+        e = &look[e->next + ((acc << n) >> (64 - e->sub))];
+    }
+    n += e->len;
+    // take n bits: rest of the current byte, whole bytes, then part of one
+    if (n <= br->nbits) {
+        br->nbits -= n;
+    } else {
+        n -= br->nbits;
+        in->pos += (size_t)(n >> 3);
+        br->used += (unsigned long long)(n >> 3);
+        br->nbits = 0;
+        if (n & 7) {
+            br->byte = in->buf[in->pos++];
+            br->used++;
+            br->nbits = 8 - (n & 7);
+        }
+    }
+    return &cb->nodes[e->node];
+}
+
+// ------------------ write leaf symbols reached without bits -------------------------
+// a table with one symbol has an empty code, follow such leaves until a real tree
+// (*ptab = its table). return 1 at EOF, 0 at inner node, -1 on error
+static inline int take_leaves(const Codebook *cb, const Node **pcurr, int *ptab, const Node **plast, BitIn *br, OutStream *out, long long *total_bytes) {
+    const Node *nodes = cb->nodes;
+    const Node *curr = *pcurr;
+    int steps = 0;
+    while (curr->is_leaf) {
+        // 檢查是否為 EOF
+        if (curr->is_leaf == LEAF_EOF) return 1;
+
+        if (curr->is_leaf == LEAF_RUN) {
+            // last symbol again: length bucket b from run length tree, then b more bits
+            const Node *last = *plast, *lc = &nodes[cb->lenroot];
+            if (last == NULL || cb->lenroot == 0) { fprintf(stderr, "Error: RUN without symbol.\n"); return -1; }
+            while (!lc->is_leaf) {
+                int bit = get_bit(br);
+                if (bit < 0) return 0; // end of data
+                int child = bit ? lc->right : lc->left;
+                if (child == 0) { fprintf(stderr, "Error: Invalid path (code not found in tree).\n"); return -1; }
+                lc = &nodes[child];
+            }
+            unsigned long long run = 1;
+            for (int b = 0; b < lc->next; b++) {
+                int bit = get_bit(br);
+                if (bit < 0) return 0;
+                run = (run << 1) | bit;
+            }
+            out_repeat(out, last->chr, last->useLen, run);
+            (*total_bytes) += run;
+            *ptab = last->next; // context is still the repeated symbol
+            curr = &nodes[cb->roots[*ptab]];
+            steps = 0;
+            continue;
+        }
+
+        if (curr->is_leaf == LEAF_ESC) {
+            // symbol not in codebook (sampled statistics): 4 bits length - 1, then raw bytes
+            int n = 0;
+            for (int b = 0; b < 4; b++) {
+                int bit = get_bit(br);
+                if (bit < 0) return 0;
+                n = (n << 1) | bit;
+            }
+            for (int i = 0; i <= n; i++) {
+                int c = 0;
+                for (int b = 0; b < 8; b++) {
+                    int bit = get_bit(br);
+                    if (bit < 0) return 0;
+                    c = (c << 1) | bit;
+                }
+                out_putc(out, c);
+            }
+            (*total_bytes)++;
+            *plast = NULL;
+            *ptab = 0;
+            curr = &nodes[cb->roots[0]];
+            steps = 0;
+            continue;
+        }
+
+        // 寫入解碼後的字元
+        if (curr->useLen == 1) out_putc(out, curr->chr[0]);
+        else out_write(out, curr->chr, curr->useLen);
+        (*total_bytes)++;
+        *plast = curr;
+
+        // 重置回樹根，準備解下一個字 (table of this symbol)
+        *ptab = curr->next;
+        curr = &nodes[cb->roots[*ptab]];
+        if (curr->is_leaf && ++steps > cb->ntables) { // same empty codes again: never ends
+            fprintf(stderr, "Error: codebook loops without EOF.\n");
+            return -1;
+        }
+    }
+    *pcurr = curr;
+    return 0;
+}
+
+// ------------------ bits of several at a time (tANS), at most limit bytes -------------------------
+typedef struct {
+    InStream *in;
+    uint64_t acc;                 // last bytes read, cnt low bits unused yet
+    int cnt, eof;
+    unsigned long long used, limit;
+} BitBuf;
+
+static inline uint32_t bb_get(BitBuf *b, int n) { // n <= 32
+    while (b->cnt < n) {
+        int c = (b->used < b->limit) ? in_getc(b->in) : EOF;
+        if (c == EOF) { c = 0; b->eof = 1; } else b->used++;
+        b->acc = (b->acc << 8) | (uint64_t)c;
+        b->cnt += 8;
+    }
+    b->cnt -= n;
+    return (uint32_t)((b->acc >> b->cnt) & ((1ull << n) - 1));
+}
+
+// ------------------ tANS payload: blocks until symbol count 0 -------------------------
+static inline long long decode_ans(const Codebook *cb, InStream *in, OutStream *out, unsigned long long limit) {
+    if (cb->ans_log < 0) { fprintf(stderr, "Error: tANS counts don't fill the table.\n"); return -1; }
+    BitBuf b = { in, 0, 0, 0, 0, limit };
+    const AnsEntry *tab = cb->ans_tab;
+    const AnsSym *sym = cb->ans_sym;
+    long long total = 0;
+    for (;;) {
+        uint32_t n = bb_get(&b, 32);
+        if (n == 0 || b.eof) break;
+        uint32_t x = bb_get(&b, cb->ans_log);
+        for (uint32_t i = 0; i < n; i++) { // state -> symbol, next state from table and bits
+            const AnsEntry *e = &tab[x];
+            const AnsSym *s = &sym[e->sym];
+            if (s->useLen == 1) out_putc(out, s->chr[0]);
+            else out_write(out, s->chr, s->useLen);
+            x = e->base + bb_get(&b, e->nb);
+        }
+        total += n;
+    }
+    if (b.eof) { fprintf(stderr, "Error: tANS data ends early.\n"); return -1; }
+    // skip rest of frame payload
+    while (limit != (unsigned long long)-1 && b.used < limit && in_getc(in) != EOF) b.used++;
+    return total;
+}
+
+// ------------------ decode bits until EOF code -------------------------
+// a code at a time through the lookup tables, bit by bit through the tree near the
+// end of the data. reads at most limit bytes, return decoded symbols or -1 on error
+static inline long long decode_bits(const Codebook *cb, InStream *in, OutStream *out, unsigned long long limit) {
+    if (cb->ans_log != 0) return decode_ans(cb, in, out, limit);
+    const Node *nodes = cb->nodes;
+    int t = cb->start;
+    const Node *curr = &nodes[cb->roots[t]];
+    const Node *last = NULL; // last symbol written (for RUN)
+    long long total_bytes = 0;
+    BitIn br = { in, 0, 0, 0, limit };
+
+    // empty input: only EOF in table
+    if (curr->is_leaf && curr->useLen == 0) return 0;
+    int eof_found = take_leaves(cb, &curr, &t, &last, &br, out, &total_bytes);
+
+    while (eof_found == 0) {
+        const Node *next = NULL;
+        if (curr == &nodes[cb->roots[t]] && cb->look_bits[t] > 0) next = look_code(cb, t, &br);
+        if (next == NULL) {
+            int bit = get_bit(&br);
+            if (bit < 0) break; // end of data
+            next = &nodes[bit ? curr->right : curr->left];
+        }
+
+        // 錯誤檢查：如果路徑不存在 (樹建錯了或檔案壞了)
+        if (next == nodes) {
+            fprintf(stderr, "Error: Invalid path (code not found in tree).\n");
+            return -1;
+        }
+        curr = next;
+
+        // 到達葉子節點
+        if (curr->is_leaf) eof_found = take_leaves(cb, &curr, &t, &last, &br, out, &total_bytes);
+    }
+    if (eof_found < 0) return -1;
+    // skip rest of frame payload
+    while (limit != (unsigned long long)-1 && br.used < limit && in_getc(in) != EOF) br.used++;
+    return total_bytes;
+}
+
+// ------------------ read frame header and codebook -------------------------
+// *text = malloc'd codebook text (one spare byte), return 1 = frame, 0 = end of stream, -1 = error
+// archive index frames are skipped, FRAME_STORED frames come with an empty text
+static inline int read_frame(InStream *in, char **text, uint64_t *cb_len, uint64_t *payload_len, int *flags, int *type) {
+    unsigned char head[4];
+    size_t n = in_read(in, head, 4);
+    *text = NULL;
+    if (n == 0) return 0;
+    if (n == 4 && head[0] == FRAME_MAGIC0 && head[1] == FRAME_MAGIC1 && head[2] == FRAME_INDEX) {
+        uint64_t skip;
+        if (!in_get_le(in, 4, cb_len) || *cb_len != 0 || !in_get_le(in, 8, &skip)) {
+            fprintf(stderr, "Error: truncated frame header.\n");
+            return -1;
+        }
+        while (skip > 0 && in_getc(in) != EOF) skip--;
+        return read_frame(in, text, cb_len, payload_len, flags, type);
+    }
+    if (n != 4 || head[0] != FRAME_MAGIC0 || head[1] != FRAME_MAGIC1
+        || (head[2] != FRAME_HUFFMAN && head[2] != FRAME_ORDER1 && head[2] != FRAME_ANS && head[2] != FRAME_STORED)
+        || !in_get_le(in, 4, cb_len) || (head[2] == FRAME_STORED && *cb_len != 0)) {
+        fprintf(stderr, "Error: not an encoded stream with codebook.\n");
+        return -1;
+    }
+    char *cb = (char*)malloc(*cb_len + 1);
+    if (cb == NULL || in_read(in, cb, *cb_len) != *cb_len || !in_get_le(in, 8, payload_len)) {
+        fprintf(stderr, "Error: truncated frame header.\n");
+        free(cb);
+        return -1;
+    }
+    *text = cb;
+    *flags = head[3];
+    *type = head[2];
+    return 1;
+}
+
+// ------------------ FRAME_STORED payload: the bytes as they are -------------------------
+// whole blocks to the output, no decoding; return bytes copied, -1 if the frame is cut short
+static inline long long copy_stored(InStream *in, OutStream *out, uint64_t len) {
+    uint64_t left = len;
+    while (left > 0 && in->nback > 0) { out_putc(out, in->back[--in->nback]); left--; }
+    while (left > 0) {
+        if (in->pos == in->len && !in_refill(in)) {
+            fprintf(stderr, "Error: stored frame ends early.\n");
+            return -1;
+        }
+        size_t k = in->len - in->pos;
+        if (k > left) k = (size_t)left;
+        out_write(out, in->buf + in->pos, k);
+        in->pos += k;
+        left -= k;
+    }
+    return (long long)len;
+}
+
+// ------------------ check crc of decoded bytes -------------------------
+// FRAME_CRC frame: crc follows the payload, return 0 = mismatch
+static inline int frame_crc_ok(InStream *in, int flags, uint32_t crc) {
+    uint64_t v;
+    if (!(flags & FRAME_CRC)) return 1;
+    if (!in_get_le(in, 4, &v)) { fprintf(stderr, "Error: truncated frame checksum.\n"); return 0; }
+    if ((uint32_t)v != crc) { fprintf(stderr, "Error: checksum mismatch (%08x, expected %08x).\n", crc, (uint32_t)v); return 0; }
+    return 1;
+}
+// separate codebook file with "#crc32c" line
+static inline int cb_crc_ok(const Codebook *cb, uint32_t crc) {
+    if (!cb->has_crc || cb->crc == crc) return 1;
+    fprintf(stderr, "Error: checksum mismatch (%08x, expected %08x).\n", crc, cb->crc);
+    return 0;
+}
+
+#endif
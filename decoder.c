@@ -1,229 +1,374 @@
+#define _FILE_OFFSET_BITS 64 // files over 2 GiB on 32-bit systems
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "decode.h" // codebook tables & huffman decoding (bufio.h, frame.h)
+#include "stream.h" // push-style decoding (-z)
+#include <stdint.h>
 
-// max symbol length (UTF-8 or Big5)
-#define MAX_SYMB_LEN 4
-
-// huffman tree node structure
-typedef struct Node {
-    struct Node *left;    // left child (bit 0)
-    struct Node *right;   // right child (bit 1)
-    int is_leaf;          // is leaf node
-    
-    unsigned char chr[MAX_SYMB_LEN]; // symbol bytes
-    int useLen;           // symbol byte length
-} Node;
+// ---------------------- whole codebook file, one spare byte ---------------------------
+static char* read_text(FILE *fp, size_t *len){
+    size_t cap = 4096, n = 0, k;
+    char *s = (char*)malloc(cap + 1);
+    while (s && (k = fread(s + n, 1, cap - n, fp)) > 0) {
+        n += k;
+        if (n == cap) s = (char*)realloc(s, (cap *= 2) + 1);
+    }
+    *len = n;
+    return s;
+}
 
-// huffman tree root
-Node *Root = NULL;
+// ---------------------- archive member index (see frame.h) ---------------------------
+typedef struct {
+    char *name;
+    uint64_t at, size;   // frame offset, original bytes
+} Entry;
 
-// ------------------ create a new node -------------------------
-Node* create_node() {
-    Node *node = (Node*)calloc(1, sizeof(Node));
-    return node;
+static int get_le(FILE *fp, int nbytes, uint64_t *v){
+    unsigned char b[8];
+    if (fread(b, 1, nbytes, fp) != (size_t)nbytes) return 0;
+    *v = 0;
+    for (int i = nbytes - 1; i >= 0; i--) *v = (*v << 8) | b[i];
+    return 1;
 }
-
-// ------------------- insert code to huffman tree ------------------------
-//  root, code, chr(symbol), len(symbol length)
-void insert_code(Node *root, const char *code, const unsigned char *chr, int len) {
-    Node *curr = root;
-    const char *p = code;
-    
-    // follow the code path 0 or 1 until the end, then build the tree
-    while (*p != '\0') {
-        if (*p == '0') {
-            if (curr->left == NULL) {
-                curr->left = create_node();
-            }
-            curr = curr->left;
-        } else if (*p == '1') {
-            if (curr->right == NULL) {
-                curr->right = create_node();
-            }
-            curr = curr->right;
+// NULL if fp is no archive
+static Entry* read_index(FILE *fp, int *n){
+    unsigned char head[4];
+    uint64_t at, cb_len, len, cnt;
+    if (fseeko(fp, -8, SEEK_END) != 0 || !get_le(fp, 8, &at) || fseeko(fp, (off_t)at, SEEK_SET) != 0
+        || fread(head, 1, 4, fp) != 4 || head[0] != FRAME_MAGIC0 || head[1] != FRAME_MAGIC1 || head[2] != FRAME_INDEX
+        || !get_le(fp, 4, &cb_len) || cb_len != 0 || !get_le(fp, 8, &len) || !get_le(fp, 4, &cnt) || cnt > len / 18) return NULL;
+    Entry *e = (Entry*)calloc(cnt + 1, sizeof(Entry));
+    for (uint64_t i = 0; e && i < cnt; i++) {
+        uint64_t nl;
+        if (!get_le(fp, 2, &nl) || (e[i].name = (char*)calloc(nl + 1, 1)) == NULL || fread(e[i].name, 1, nl, fp) != nl
+            || !get_le(fp, 8, &e[i].at) || !get_le(fp, 8, &e[i].size)) {
+            for (uint64_t k = 0; k <= i; k++) free(e[k].name);
+            free(e);
+            return NULL;
         }
-        p++;
     }
-    
-    // go to leaf node, set symbol
-    curr->is_leaf = 1;
-    memcpy(curr->chr, chr, len);
-    curr->useLen = len;
+    *n = (int)cnt;
+    return e;
 }
-
-// --------------------- build tree with codebook ------------------------
-// search codebook line backwards to parse fields
-// CSV : "Symbol",count,prob,code,info
-void parse_and_build(char *line) {
-    // remove newline characters
-    int len = strlen(line);
-    while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
-        line[--len] = '\0';
-    }
-    if (len == 0) return;
-
-    // find code and symbol fields by scanning backwards
-    // find last 4 commas, second last is code, fourth last is symbol
-    char *ptr = line + len - 1;
-    int comma_cnt = 0;
-    char *code_start = NULL;
-    char *symbol_end = NULL; // address of the end of symbol field
-
-    while (ptr >= line) {
-        if (*ptr == ',') {
-            comma_cnt++;
-            if (comma_cnt == 2) {
-                // code, at the second last comma
-                code_start = ptr + 1;
-                // 將這個逗號改成 \0，切斷 code 與後面的 info
-                // 注意：原本格式是 code,info。我們其實只需要 code 開頭
-                // 但為了取字串，我們在 code 的下一個逗號(倒數第1個)也切斷比較保險
-                // 這裡簡化處理：直接抓 code_start
-            } 
-            else if (comma_cnt == 4) {
-                // 找到 Symbol 結束的位置 (在倒數第4個逗號之前)
-                symbol_end = ptr;
-                *symbol_end = '\0'; // 切斷！這裡之前就是 Symbol 字串
-                break; 
-            }
+static void free_index(Entry *e, int n){
+    for (int i = 0; i < n; i++) free(e[i].name);
+    free(e);
+}
+// codebook of the first coded member up to last (stored members before it carry none)
+static int index_codebook(InStream *in, const Entry *e, int last, Codebook *cb, const char *cache_dir){
+    char *text;
+    uint64_t cb_len, payload_len;
+    int flags, type;
+    for (int j = 0; j <= last; j++) {
+        if (!in_seek(in, (long long)e[j].at) || read_frame(in, &text, &cb_len, &payload_len, &flags, &type) <= 0) return 0;
+        if (type != FRAME_STORED || j == last) { // all stored: unused empty codebook
+            cb_from_cache(cb, cache_dir, text, cb_len);
+            free(text);
+            return 1;
         }
-        ptr--;
+        free(text);
     }
+    return 0;
+}
 
-    // 簡單的錯誤檢查
-    if (comma_cnt < 4 || code_start == NULL) return;
+// ---------------------- decoding as the data arrives (-z) ---------------------------
+// chunks are whatever a pipe / socket has, decoded bytes are written after every chunk
+typedef struct {
+    FILE *fp;
+    unsigned char *buf;
+    size_t pos, have, cap;  // unread bytes buf[pos..have)
+} Chunks;
 
-    // 處理 Code 欄位：可能後面還有逗號連著 info，需要切斷
-    // code_start 目前指向 "010101,12.34"，我們要切掉逗號
-    char *p = code_start;
-    while(*p){
-        if(*p == ',') { *p = '\0'; break; }
-        p++;
+// at least m unread bytes (reads more chunks), return 0 at end of file
+static int chunk_need(Chunks *c, size_t m){
+    if (c->have - c->pos >= m) return 1;
+    memmove(c->buf, c->buf + c->pos, c->have - c->pos);
+    c->have -= c->pos;
+    c->pos = 0;
+    if (m > c->cap) { // codebook larger than a chunk
+        c->buf = (unsigned char*)realloc(c->buf, m);
+        if (c->buf == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+        c->cap = m;
     }
+    while (c->have < m) {
+        long long k = hs_read(c->fp, c->buf + c->have, c->cap - c->have);
+        if (k <= 0) return 0;
+        c->have += (size_t)k;
+    }
+    return 1;
+}
+static uint64_t chunk_le(Chunks *c, int nbytes){
+    uint64_t v = 0;
+    for (int i = nbytes - 1; i >= 0; i--) v = (v << 8) | c->buf[c->pos + i];
+    c->pos += nbytes;
+    return v;
+}
 
-    // 3. 處理 Symbol 欄位 (line 開頭到 symbol_end)
-    char *raw_sym = line;
-    
-    // 去除前後的引號 " "
-    if (raw_sym[0] == '"') raw_sym++; // 跳過第一個引號
-    int rlen = strlen(raw_sym);
-    if (rlen > 0 && raw_sym[rlen-1] == '"') raw_sym[rlen-1] = '\0'; // 去掉最後一個引號
-
-    // 4. 還原特殊字元 (與 Encoder 對應)
-    unsigned char symbol[4] = {0};
-    int symLen = 0;
-
-    if (strcmp(raw_sym, "EOF") == 0) {
-        // 特殊標記 EOF
-        strcpy((char*)symbol, "EOF");
-        symLen = 3; 
-    } else if (strcmp(raw_sym, "\\n") == 0) {
-        symbol[0] = '\n'; symLen = 1;
-    } else if (strcmp(raw_sym, "\\r") == 0) {
-        symbol[0] = '\r'; symLen = 1;
-    } else if (strcmp(raw_sym, "\\t") == 0) {
-        symbol[0] = '\t'; symLen = 1;
-    } else if (strcmp(raw_sym, "\\\"") == 0) { // \" -> "
-        symbol[0] = '\"'; symLen = 1;
-    } else if (strcmp(raw_sym, "\\\\") == 0) { // \\ -> \
-        symbol[0] = '\\'; symLen = 1;
-    } else {
-        // 一般字元，處理雙引號還原 (Unescape)
-        int i = 0, j = 0;
-        while (raw_sym[i] != '\0') {
-            // 如果遇到 "" 就變成 "
-            if (raw_sym[i] == '"' && raw_sym[i+1] == '"') {
-                symbol[j++] = '"';
-                i += 2;
-            } else {
-                symbol[j++] = raw_sym[i++];
-            }
+// one payload: until the EOF code, at most limit bytes; return 0 on error
+static int stream_payload(Chunks *c, HsDec *d, unsigned char *obuf, FILE *fout, uint64_t limit){
+    uint64_t used = 0;
+    size_t w;
+    while (!d->done) {
+        if (used == limit || (c->pos == c->have && !chunk_need(c, 1))) {
+            fprintf(stderr, "Error: data ends before the EOF code.\n");
+            return 0;
         }
-        symbol[j] = '\0'; // 補上結尾符號
-        symLen = j;       // 更新正確長度
+        size_t n = c->have - c->pos;
+        if (n > limit - used) n = (size_t)(limit - used);
+        long long k = hs_dec_feed(d, c->buf + c->pos, n, obuf, IO_BLOCK, &w);
+        fwrite(obuf, 1, w, fout);
+        if (k < 0) return 0;
+        c->pos += (size_t)k;
+        used += (uint64_t)k;
+        if (c->pos == c->have) fflush(fout); // chunk done, its bytes are out
     }
-
-    // 5. 插入樹中
-    insert_code(Root, code_start, symbol, symLen);
+    fflush(fout);
+    // skip rest of frame payload
+    while (limit != FRAME_STREAMED && used < limit && chunk_need(c, 1)) {
+        size_t n = c->have - c->pos;
+        if (n > limit - used) n = (size_t)(limit - used);
+        c->pos += n;
+        used += n;
+    }
+    return 1;
 }
 
+// separate codebook (given) or frames with plain codebooks; return 0 = ok, 1 = error
+static int stream_decode(FILE *fin, FILE *fout, Codebook *given, const char *cache_dir, long long *total){
+    Chunks c = { fin, (unsigned char*)malloc(IO_BLOCK), 0, 0, IO_BLOCK };
+    unsigned char *obuf = (unsigned char*)malloc(IO_BLOCK);
+    if (c.buf == NULL || obuf == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    HsDec d;
+    Codebook cb;
+    int ret = 0, have_cb = 0;
+    *total = 0;
+    if (given) {
+        if (!hs_dec_init(&d, given)) { fprintf(stderr, "Error: -z decodes plain codebooks only.\n"); ret = 1; }
+        else if (!stream_payload(&c, &d, obuf, fout, FRAME_STREAMED)) ret = 1;
+        else if (!cb_crc_ok(given, d.crc)) ret = 1;
+        *total = d.count;
+    }
+    while (!given && chunk_need(&c, 8)) { // frame by frame
+        unsigned char *h = c.buf + c.pos;
+        int type = h[2], flags = h[3];
+        if (h[0] != FRAME_MAGIC0 || h[1] != FRAME_MAGIC1) { fprintf(stderr, "Error: not an encoded stream with codebook.\n"); ret = 1; break; }
+        c.pos += 4;
+        uint64_t cb_len = chunk_le(&c, 4), payload_len;
+        if (cb_len > ((uint64_t)1 << 31) || !chunk_need(&c, (size_t)cb_len + 8)) { fprintf(stderr, "Error: truncated frame header.\n"); ret = 1; break; }
+        if (type == FRAME_INDEX) { // archive index: skip
+            c.pos += (size_t)cb_len;
+            payload_len = chunk_le(&c, 8);
+            while (payload_len > 0 && chunk_need(&c, 1)) {
+                size_t n = c.have - c.pos;
+                if (n > payload_len) n = (size_t)payload_len;
+                c.pos += n;
+                payload_len -= n;
+            }
+            continue;
+        }
+        uint32_t crc;
+        if (type == FRAME_STORED) { // bytes as they arrive, codebook stays
+            c.pos += (size_t)cb_len;
+            payload_len = chunk_le(&c, 8);
+            crc = 0;
+            while (payload_len > 0 && chunk_need(&c, 1)) {
+                size_t n = c.have - c.pos;
+                if (n > payload_len) n = (size_t)payload_len;
+                fwrite(c.buf + c.pos, 1, n, fout);
+                crc = crc32c(crc, c.buf + c.pos, n);
+                c.pos += n;
+                payload_len -= n;
+                *total += (long long)n;
+                if (c.pos == c.have) fflush(fout);
+            }
+            fflush(fout);
+            if (payload_len > 0) { fprintf(stderr, "Error: stored frame ends early.\n"); ret = 1; break; }
+        } else {
+            if (!(flags & FRAME_SAME_CB)) { // new codebook, else keep the one before
+                char *text = (char*)malloc(cb_len + 1);
+                if (text == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+                memcpy(text, c.buf + c.pos, (size_t)cb_len);
+                if (have_cb) cb_free(&cb);
+                cb_from_cache(&cb, cache_dir, text, cb_len);
+                have_cb = 1;
+                free(text);
+            }
+            c.pos += (size_t)cb_len;
+            payload_len = chunk_le(&c, 8);
+            if (!have_cb) { fprintf(stderr, "Error: first frame has no codebook.\n"); ret = 1; break; }
+            if (type != FRAME_HUFFMAN || !hs_dec_init(&d, &cb)) { fprintf(stderr, "Error: -z decodes plain codebooks only.\n"); ret = 1; break; }
+            if (!stream_payload(&c, &d, obuf, fout, payload_len)) { ret = 1; break; }
+            *total += d.count;
+            crc = d.crc;
+        }
+        if (flags & FRAME_CRC) {
+            if (!chunk_need(&c, 4)) { fprintf(stderr, "Error: truncated frame checksum.\n"); ret = 1; break; }
+            uint32_t want = (uint32_t)chunk_le(&c, 4);
+            if (want != crc) { fprintf(stderr, "Error: checksum mismatch (%08x, expected %08x).\n", crc, want); ret = 1; break; }
+        }
+    }
+    if (have_cb) cb_free(&cb);
+    free(c.buf);
+    free(obuf);
+    return ret;
+}
 
 // ---------------------- main ---------------------------
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s output_file codebook_csv encoded_bin\n", argv[0]);
+    // options before file names
+    int pipelined = 0; // -p: reader / writer threads overlap i/o with decoding
+    const char *cache_dir = NULL; // -k: compiled decode tables of codebooks seen before
+    const char *member = NULL;    // -x: only this member of an archive
+    int list = 0;                 // -l: list members of an archive
+    int streamed = 0;             // -z: decode chunks as they arrive
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+        if (strcmp(argv[argi], "-p") == 0) pipelined = 1;
+        else if (strcmp(argv[argi], "-k") == 0 && argi + 1 < argc) cache_dir = argv[++argi];
+        else if (strcmp(argv[argi], "-x") == 0 && argi + 1 < argc) member = argv[++argi];
+        else if (strcmp(argv[argi], "-l") == 0) list = 1;
+        else if (strcmp(argv[argi], "-z") == 0) streamed = 1;
+        else { fprintf(stderr, "unknown option %s\n", argv[argi]); return -1; }
+        argi++;
+    }
+    if (list && argc - argi == 1) {
+        FILE *fp = fopen(argv[argi], "rb");
+        int n;
+        Entry *e = fp ? read_index(fp, &n) : NULL;
+        if (e == NULL) { fprintf(stderr, "%s: not an archive\n", argv[argi]); return -1; }
+        for (int i = 0; i < n; i++) printf("%12llu  %s\n", (unsigned long long)e[i].size, e[i].name);
+        free_index(e, n);
+        fclose(fp);
+        return 0;
+    }
+    // "-" as output_file / encoded_bin: stdout / stdin, "-" as codebook_csv: codebook embedded in encoded stream
+    if (argc - argi != 3 || list || (member && (streamed || strcmp(argv[argi+1], "-") != 0))) {
+        fprintf(stderr, "Usage: %s [-p | -z] [-k cache_dir] output_file codebook_csv encoded_bin\n"
+                        "       %s [-k cache_dir] -x member output_file - archive\n"
+                        "       %s -l archive\n", argv[0], argv[0], argv[0]);
         return -1;
     }
+    int embed_cb = strcmp(argv[argi+1], "-") == 0;
+    FILE *msg = strcmp(argv[argi], "-") == 0 ? stderr : stdout; // keep stdout clean for data
 
-    FILE *fout = fopen(argv[1], "wb");
-    FILE *fcsv = fopen(argv[2], "r");
-    FILE *fin  = fopen(argv[3], "rb");
+    FILE *fout = open_stream(argv[argi], "wb");
+    FILE *fcsv = embed_cb ? NULL : fopen(argv[argi+1], "rb");
+    FILE *fin  = open_stream(argv[argi+2], "rb");
 
-    if (!fout || !fcsv || !fin) {
+    if (!fout || (!fcsv && !embed_cb) || !fin) {
         perror("File open error");
         return -1;
     }
 
-    // intialize Huffman Tree
-    Root = create_node();
-
-    // read codebook and build Huffman Tree
-    char lineBuf[1024];
-    while (fgets(lineBuf, sizeof(lineBuf), fcsv)) {
-        parse_and_build(lineBuf);
+    if (streamed) {
+        // push-style decoder, no blocks to fill first
+        long long total;
+        int ret = 0;
+        Codebook cb;
+        if (!embed_cb) {
+            size_t len;
+            char *text = read_text(fcsv, &len);
+            if (text == NULL) { fprintf(stderr, "out of memory\n"); return -1; }
+            cb_from_cache(&cb, cache_dir, text, len);
+            free(text);
+            fclose(fcsv);
+        }
+        ret = stream_decode(fin, fout, embed_cb ? NULL : &cb, cache_dir, &total);
+        if (!embed_cb) cb_free(&cb);
+        fprintf(msg, "Decoding finished. Total symbols: %lld\n", total);
+        fclose(fin);
+        if (ferror(fout) | fclose(fout)) { perror(argv[argi]); ret = 1; }
+        return ret;
     }
-    printf("Huffman Tree built successfully.\n");
-    fclose(fcsv);
-
-    // decode the file
-    Node *curr = Root;
-    int c;
-    long total_bytes = 0;
-    int eof_found = 0;
-
-    // 讀取每一個 byte
-    while ((c = fgetc(fin)) != EOF) {
-        if (eof_found) break; 
-
-        // 讀取 byte 中的每一個 bit (7 -> 0)
-        for (int i = 7; i >= 0; i--) {
-            int bit = (c >> i) & 1;
-
-            if (bit == 0) {
-                curr = curr->left;
-            } else {
-                curr = curr->right;
-            }
-
-            // 錯誤檢查：如果路徑不存在 (樹建錯了或檔案壞了)
-            if (curr == NULL) {
-                fprintf(stderr, "Error: Invalid path (code not found in tree).\n");
-                goto CLEANUP;
-            }
 
-            // 到達葉子節點
-            if (curr->is_leaf) {
-                // 檢查是否為 EOF
-                if (curr->useLen == 3 && strncmp((char*)curr->chr, "EOF", 3) == 0) {
-                    eof_found = 1;
-                    break; // 跳出 bit 迴圈
-                }
+    InStream in;
+    OutStream out;
+    in_open(&in, fin, pipelined && !member); // -x seeks
+    out_open(&out, fout, pipelined);
+    long long total_bytes = 0;
+    int ret = 0;
+    Codebook cb;
 
-                // 寫入解碼後的字元
-                fwrite(curr->chr, 1, curr->useLen, fout);
-                total_bytes++;
+    if (member) {
+        // one archive member: codebook of the first coded frame, then the member's frame
+        int n, i = 0, r, flags, type;
+        char *text;
+        uint64_t cb_len, payload_len;
+        Entry *e = read_index(fin, &n);
+        while (e && i < n && strcmp(e[i].name, member) != 0) i++;
+        if (e == NULL || i == n) {
+            fprintf(stderr, "Error: %s not found in archive.\n", member);
+            ret = 1;
+        } else if (!index_codebook(&in, e, i, &cb, cache_dir)) {
+            ret = 1;
+        } else {
+            if (!in_seek(&in, (long long)e[i].at) || (r = read_frame(&in, &text, &cb_len, &payload_len, &flags, &type)) <= 0) ret = 1;
+            else {
+                free(text); // first coded member: its codebook is the one loaded
+                out_crc_start(&out);
+                if (type == FRAME_STORED) total_bytes = copy_stored(&in, &out, payload_len);
+                else total_bytes = decode_bits(&cb, &in, &out, payload_len);
+                if (total_bytes < 0) { total_bytes = 0; ret = 1; }
+                else if (!frame_crc_ok(&in, flags, out_crc_end(&out))) ret = 1;
+            }
+            cb_free(&cb);
+        }
+        if (e) free_index(e, n);
+    } else if (!embed_cb) {
+        // read codebook and build Huffman Tree (or map it from the cache)
+        size_t len;
+        char *text = read_text(fcsv, &len);
+        if (text == NULL) { fprintf(stderr, "out of memory\n"); return -1; }
+        if (cb_from_cache(&cb, cache_dir, text, len)) fprintf(msg, "Decode tables loaded from cache.\n");
+        else fprintf(msg, "Huffman Tree built successfully.\n");
+        free(text);
+        fclose(fcsv);
 
-                // 重置回樹根，準備解下一個字
-                curr = Root;
+        // decode the file
+        out_crc_start(&out);
+        total_bytes = decode_bits(&cb, &in, &out, (unsigned long long)-1);
+        if (total_bytes < 0) { total_bytes = 0; ret = 1; }
+        else if (!cb_crc_ok(&cb, out_crc_end(&out))) ret = 1;
+        cb_free(&cb);
+    } else {
+        // decode frame by frame
+        char *text;
+        uint64_t cb_len, payload_len;
+        int r, flags, type, have_cb = 0;
+        while ((r = read_frame(&in, &text, &cb_len, &payload_len, &flags, &type)) > 0) {
+            if (type == FRAME_STORED) { // copied straight through, codebook stays
+                free(text);
+                out_crc_start(&out);
+                long long k = copy_stored(&in, &out, payload_len);
+                if (k < 0) { ret = 1; break; }
+                total_bytes += k;
+                if (!frame_crc_ok(&in, flags, out_crc_end(&out))) { ret = 1; break; }
+                continue;
+            }
+            if (!(flags & FRAME_SAME_CB)) { // new codebook, else keep the one before
+                if (have_cb) cb_free(&cb);
+                cb_from_cache(&cb, cache_dir, text, cb_len);
+                have_cb = 1;
             }
+            free(text);
+            if (!have_cb) { fprintf(stderr, "Error: first frame has no codebook.\n"); ret = 1; break; }
+
+            out_crc_start(&out);
+            long long k = decode_bits(&cb, &in, &out, payload_len);
+            if (k < 0) { ret = 1; break; }
+            total_bytes += k;
+            if (!frame_crc_ok(&in, flags, out_crc_end(&out))) { ret = 1; break; }
         }
+        if (have_cb) cb_free(&cb);
+        if (r < 0) ret = 1;
     }
 
-CLEANUP:
-    printf("Decoding finished. Total symbols: %ld\n", total_bytes);
+    if (in.err) { errno = in.err; perror(argv[argi+2]); ret = 1; } // input cut by a read error
+    fprintf(msg, "Decoding finished. Total symbols: %lld\n", total_bytes);
+    in_close(&in);
+    if (out_close(&out) != 0 || fclose(fout) != 0) { perror(argv[argi]); ret = 1; }
     fclose(fin);
-    fclose(fout);
     
-    return 0;
-} 
\ No newline at end of file
+    return ret;
+}
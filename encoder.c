@@ -1,16 +1,25 @@
 //this is for encoder
+#define _FILE_OFFSET_BITS 64 // files over 2 GiB on 32-bit systems
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <math.h> // for log2
+#include "bufio.h" // buffered / pipelined i/o
+#include "frame.h" // embedded codebook stream format
+#include "decode.h" // codebook parsing (append mode)
+#include "charset.h" // utf-8 / big-5 symbol boundaries
+#include "stream.h" // push-style stream encoder (-u without -A)
 
 #define BYTE_MAX     256  //maximum one byte number
 #define MAX_SYMB     3000  //maximux symbol type
+#define SPECIAL_ROOM 3     //types kept for "EOF", "RUN", "ESC" (added after counting starts)
+#define MAX_TOKEN_LEN 16   //longest merged token (-m), bytes
 
 typedef struct Symb{
-    unsigned char chr[4];     //bytes of symbol
-    int useLen;               //size: 1~4 bytes
-    int count;                //number of this symbol
+    unsigned char chr[MAX_TOKEN_LEN]; //bytes of symbol
+    int useLen;               //size: 1~4 bytes, merged token up to MAX_TOKEN_LEN
+    long long count;          //number of this symbol (64-bit, inputs over 2^31 symbols)
     double prob;              //probability 
     char code[256];           //fixed encode
 
@@ -23,27 +32,138 @@ typedef struct Symb{
 unsigned char byteBuffer = 0; // byte buffer for output (8 bits)
 int bitInBuff = 0; //number of bits in buffer
 
-//------------------ utf-8 decoding ------------------ 
-static int utf8_len(unsigned char b0){  //use first byte to check UTF-8 using length
-    if ((b0 & 0x80)==0x00) return 1; //0xxxxxxx
-    if ((b0 & 0xE0)==0xC0) return 2; //110xxxxx
-    if ((b0 & 0xF0)==0xE0) return 3; //1110xxxx
-    if ((b0 & 0xF8)==0xF0) return 4; //11110xxx
-    return 0;  
+// -------------- read one symbol (ascii / utf-8 / big-5 / single byte) --------------
+// store symbol bytes in tmp[], return symbol length (1~4), 0 at end of file
+static int read_symbol(InStream *in, unsigned char tmp[4]){
+    int c = in_getc(in);
+    if (c == EOF) return 0;
+    unsigned char b0 = (unsigned char)c;
+    tmp[0] = b0; // first byte
+    // handle ascii 0~127
+    if (b0 <= 0x7F) return 1;
+
+    // handle multibyte symbol (utf-8 / big5)
+    int symbLen = 1;
+    int uLen = 0; // symbol use length (bytes)
+    int read = 1, ok = 0;
+
+    // try utf-8
+    uLen = utf8_len(b0); // check is legal utf-8 first byte & length
+    if (uLen > 1){
+        ok = 1;
+        for (int i = 1; i < uLen; i++){
+            int d = in_getc(in);
+            if (d == EOF){ ok = 0; break; } // end of file break
+            tmp[read++] = (unsigned char)d; // store symbol in tmp[] (2~4 bytes)
+            if (!is_utf8_follow(tmp[read-1])){ ok = 0; break; } // illegal following utf-8 byte
+        }
+    }
+    if (ok){
+        symbLen = uLen; // save utf-8 length
+    } else {
+        for (int j = read-1; j >= 1; --j) in_ungetc(in, tmp[j]); // push back to b0
+    }
+
+    // try big-5
+    if (symbLen == 1){  // check not utf-8 (symbLen unchanged)
+        uLen = big5_len(b0); // check is legal big-5 first byte & length
+        if (uLen == 2){
+            int d = in_getc(in); // read following byte (second byte)
+            if (d != EOF && is_big5_follow((unsigned char)d)){ // legal big-5 follow byte
+                tmp[1] = (unsigned char)d;
+                symbLen = 2;   // big-5 always 2 bytes
+            } else {
+                if (d != EOF) in_ungetc(in, d); // push back to b0
+            }
+        }
+    }
+    // symbLen unchanged -> unknown one byte symbol (128~255)
+    return symbLen;
 }
-static int is_utf8_follow(unsigned char b){ //check is UTF-8 follow byte legal (10xxxxxx)
-    return (b & 0xC0)==0x80; //10xxxxxx
+
+// ================== charset-specialized tokenizers ==================
+// same symbol boundaries as read_symbol(), but read straight from the input block.
+// each charset checks its common case first and falls back to the mixed rules,
+// so the charset only changes speed, never the symbols
+enum { CS_AUTO, CS_MIXED, CS_ASCII, CS_UTF8, CS_BIG5 };
+#define DETECT_BYTES    65536      // bytes looked at by charset detection
+
+int charset = CS_AUTO;             // -t
+
+static inline int scan_symbol(const unsigned char *p, int cs){
+    unsigned char b0 = p[0];
+    if (b0 <= 0x7F) return 1;
+    if (cs == CS_UTF8) {
+        if ((b0 & 0xF0) == 0xE0 && is_utf8_follow(p[1]) && is_utf8_follow(p[2])) return 3; // CJK
+        if ((b0 & 0xE0) == 0xC0 && is_utf8_follow(p[1])) return 2;
+    } else if (cs == CS_BIG5) {
+        // lead 0x81~0xBF is no utf-8 lead: only big-5 is possible
+        if (b0 >= 0x81 && b0 <= 0xBF) return is_big5_follow(p[1]) ? 2 : 1;
+    }
+    return scan_mixed(p);
 }
 
-//------------------ big-5 decoding ------------------ 
-static int big5_len(unsigned char b0){
-    if (b0 <= 0x7F) return 1;                 // first byte < 127 ->ASCII
-    if (b0 >= 0x81 && b0 <= 0xFE) return 2;   // first byte is big-5 high byte 0x81-0xFE
-    return 1;                                 
+// -------------- read one symbol with charset cs --------------
+static inline int read_symbol_cs(InStream *in, unsigned char tmp[4], int cs){
+    if (in->nback == 0 && in->pos + 4 <= in->len) {
+        const unsigned char *p = in->buf + in->pos;
+        int n = scan_symbol(p, cs);
+        memcpy(tmp, p, 4); // only n bytes are the symbol
+        in->pos += n;
+        return n;
+    }
+    return read_symbol(in, tmp); // end of block: byte by byte
 }
-static int is_big5_follow(unsigned char b1){
-    // big5 low byte 0x40-0x7E , 0xA1-0xFE
-    return ( (b1 >= 0x40 && b1 <= 0x7E) || (b1 >= 0xA1 && b1 <= 0xFE) ); //check is big-5 rule
+static int read_ascii(InStream *in, unsigned char tmp[4]){ return read_symbol_cs(in, tmp, CS_ASCII); }
+static int read_utf8(InStream *in, unsigned char tmp[4]){ return read_symbol_cs(in, tmp, CS_UTF8); }
+static int read_big5(InStream *in, unsigned char tmp[4]){ return read_symbol_cs(in, tmp, CS_BIG5); }
+static int read_mixed(InStream *in, unsigned char tmp[4]){ return read_symbol_cs(in, tmp, CS_MIXED); }
+
+// -------------- pick charset from the first block (not consumed) --------------
+static int detect_charset(InStream *in){
+    if (in->nback != 0 || (in->pos == in->len && !in_refill(in))) return CS_MIXED;
+    const unsigned char *p = in->buf + in->pos;
+    size_t n = in->len - in->pos;
+    if (n > DETECT_BYTES) n = DETECT_BYTES;
+    long long utf8 = 0, big5 = 0, other = 0;
+    for (size_t i = 0; i + 4 <= n; ) {
+        int len = scan_mixed(p + i);
+        if (p[i] > 0x7F) {
+            if (len > 1 && utf8_len(p[i]) == len) utf8++;
+            else if (len == 2) big5++;
+            else other++;
+        }
+        i += len;
+    }
+    if (utf8 + big5 + other == 0) return CS_ASCII;
+    if (other * 8 > utf8 + big5) return CS_MIXED; // binary-like, no common case
+    return utf8 >= big5 ? CS_UTF8 : CS_BIG5;
+}
+
+// -------------- find symbol index in symb[] --------------
+// one byte symbols use their byte value, multibyte symbols are looked up in a hash table
+#define SYMB_SLOTS   8192  //hash slots for multibyte symbols (more than MAX_SYMB)
+static int symbSlot[SYMB_SLOTS]; //symbol index + 1, 0 = empty
+
+static int symbol_slot(const Symb *symb, const unsigned char *tmp, int symbLen){
+    unsigned h = 2166136261u; // FNV-1a
+    for (int i = 0; i < symbLen; i++) h = (h ^ tmp[i]) * 16777619u;
+    h &= SYMB_SLOTS - 1;
+    while (symbSlot[h] != 0) {
+        const Symb *s = &symb[symbSlot[h] - 1];
+        if (s->useLen == symbLen && memcmp(s->chr, tmp, symbLen) == 0) break;
+        h = (h + 1) & (SYMB_SLOTS - 1);
+    }
+    return h;
+}
+// return -1 if not found
+static int symbol_index(const Symb *symb, const unsigned char *tmp, int symbLen){
+    if (symbLen == 1) return tmp[0];
+    return symbSlot[symbol_slot(symb, tmp, symbLen)] - 1;
+}
+// new multibyte symbol symb[idx]
+static void symbol_insert(const Symb *symb, int idx){
+    symbSlot[symbol_slot(symb, symb[idx].chr, symb[idx].useLen)] = idx + 1;
 }
 
 // -------------- qsort compare function for codebook --------------
@@ -53,7 +173,7 @@ static int cmp_codebook(const void *a, const void *b){
     const Symb *y = *(const Symb**)b;
     // Primary key: symbol count (ascending)
     if(x->count != y->count) 
-        return x->count - y->count;
+        return (x->count < y->count) ? -1 : 1; // no subtraction, 64-bit counts can overflow int
     // Secondary key: symbol byte length (ascending)
     if(x->useLen != y->useLen) 
         return x->useLen - y->useLen;
@@ -63,7 +183,7 @@ static int cmp_codebook(const void *a, const void *b){
 
 // -------------- find two minimum count nodes --------------
 void find_two_min(Symb *nodes[], int n, int *min1, int *min2) {
-    int m1 = -1, m2 = -1; // store minimum counts
+    long long m1 = -1, m2 = -1; // store minimum counts
     *min1 = -1; 
     *min2 = -1;
 
@@ -142,20 +262,73 @@ void generate_codes(Symb *node, char *current_code, int depth) {
     current_code[depth] = '1';
     generate_codes(node->right, current_code, depth + 1); // recursive right
 }
-// -------------- write char to codebook csv file --------------
-static void csv_char(const unsigned char *s, int len, FILE *fp){   
-    if (len==1 && s[0]=='\r'){ fputs("\"\\r\"",fp); return; }
-    if (len==1 && s[0]=='\n'){ fputs("\"\\n\"",fp); return; }
-    if (len==1 && s[0]=='\t'){ fputs("\"\\t\"",fp); return; }
-    fputc('"',fp);
+// -------------- growable text buffer for codebook csv --------------
+typedef struct {
+    char *s;
+    size_t len, cap;
+} StrBuf;
+
+static void sb_grow(StrBuf *sb, size_t n){
+    if (sb->len + n + 1 <= sb->cap) return;
+    size_t cap = sb->cap ? sb->cap : 4096;
+    while (cap < sb->len + n + 1) cap *= 2;
+    sb->s = (char*)realloc(sb->s, cap);
+    if (sb->s == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    sb->cap = cap;
+}
+static void sb_putc(StrBuf *sb, char c){
+    sb_grow(sb, 1);
+    sb->s[sb->len++] = c;
+}
+static void sb_write(StrBuf *sb, const void *p, size_t n){
+    sb_grow(sb, n);
+    memcpy(sb->s + sb->len, p, n);
+    sb->len += n;
+}
+static void sb_puts(StrBuf *sb, const char *str){
+    sb_write(sb, str, strlen(str));
+}
+static void sb_printf(StrBuf *sb, const char *fmt, ...){
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap); // measure first
+    va_end(ap);
+    sb_grow(sb, n);
+    va_start(ap, fmt);
+    vsnprintf(sb->s + sb->len, n + 1, fmt, ap);
+    va_end(ap);
+    sb->len += n;
+}
+
+// -------------- write char to codebook csv --------------
+// zero byte as \0, a backslash that would start an escape doubled (see parse_symbol)
+static void csv_char(const unsigned char *s, int len, StrBuf *sb){   
+    if (len==1 && s[0]=='\r'){ sb_puts(sb, "\"\\r\""); return; }
+    if (len==1 && s[0]=='\n'){ sb_puts(sb, "\"\\n\""); return; }
+    if (len==1 && s[0]=='\t'){ sb_puts(sb, "\"\\t\""); return; }
+    sb_putc(sb, '"');
     for(int i=0;i<len;i++){
-        if (s[i]=='"') fputc('"',fp); // escape double quote
-        fputc(s[i],fp); // output symbol
+        if (s[i]=='"') sb_putc(sb, '"'); // escape double quote
+        if (s[i]=='\0') { sb_puts(sb, "\\0"); continue; }
+        if (s[i]=='\\' && i+1<len && (s[i+1]=='0' || s[i+1]=='\\' || s[i+1]=='\0')) sb_putc(sb, '\\');
+        sb_putc(sb, (char)s[i]); // output symbol
+    }
+    sb_putc(sb, '"');
+}
+// -------------- write n low bits of v to output file (MSB first) --------------
+static void write_bits(unsigned long long v, int n, OutStream *out){
+    for (int k = n - 1; k >= 0; k--) {
+        byteBuffer = (byteBuffer << 1) | ((v >> k) & 1);
+        bitInBuff++;
+        if (bitInBuff == 8) {
+            out_putc(out, byteBuffer);
+            bitInBuff = 0;
+            byteBuffer = 0;
+        }
     }
-    fputc('"',fp);
 }
 // -------------- write code to output file --------------
-static void write_code(const char *code, int len, FILE *fp){
+static void write_code(const char *code, int len, OutStream *out){
     for (int k = 0; k < len; k++) {
         // char '0'(48) or '1'(49) to bit 0 or 1
         byteBuffer = (byteBuffer << 1) | (code[k] - '0'); // add 0 or 1 to buffer and shift left
@@ -164,141 +337,843 @@ static void write_code(const char *code, int len, FILE *fp){
         // when buffer is full (8 bits), write to file
         if (bitInBuff == 8) {
             //fprintf(stderr, "DEBUG [Data]: 0x%02X\n", g_bitBuffer); // print debug info
-            fputc(byteBuffer, fp);
+            out_putc(out, byteBuffer);
             bitInBuff = 0;
             byteBuffer = 0;
         }
     }
 } 
 
-int main(int argc, char *argv[]) {
-    // check argument count
-    if (argc != 4) {
-        fprintf(stderr, "usage: %s in_fn cb_fn enc_fn\n", argv[0]);
-        return 1; 
+// ================== order-1 context tables (-c) ==================
+// the previous symbol selects one of a few huffman tables,
+// previous-symbol contexts with similar histograms share a table
+#define MAX_TABLES      64            // most context tables
+#define CTX_START       MAX_SYMB      // context of the first symbol (no previous symbol)
+#define CTX_SPAN        (MAX_SYMB+1)  // all symbols + start
+#define LINE_BITS       (8*8)         // compact codebook line without its code, cost of a symbol in one more table
+
+// -------------- sparse (previous, current) symbol pair counts --------------
+typedef struct {
+    unsigned key;   // prev * CTX_SPAN + cur
+    long long n;    // count, 0 = empty slot
+} PairCnt;
+
+typedef struct {
+    PairCnt *slot;
+    size_t cap, cnt;
+} PairMap;
+
+static void pair_add_n(PairMap *m, unsigned key, long long n){
+    if (2 * (m->cnt + 1) > m->cap) { // keep load under 1/2
+        PairMap big = { (PairCnt*)calloc(m->cap ? m->cap * 2 : 4096, sizeof(PairCnt)), m->cap ? m->cap * 2 : 4096, 0 };
+        if (big.slot == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+        for (size_t i = 0; i < m->cap; i++) {
+            if (m->slot[i].n) pair_add_n(&big, m->slot[i].key, m->slot[i].n);
+        }
+        free(m->slot);
+        *m = big;
     }
-    // open files
-    // Read Binary
-    FILE *fin = fopen(argv[1], "rb"); 
-    if (fin == NULL) { perror(argv[1]); return 1; }
-    // Write
-    FILE *fcsv = fopen(argv[2], "w"); 
-    if (fcsv == NULL) { perror(argv[2]); return 1; }
-    // Write Binary
-    FILE *fout = fopen(argv[3], "wb"); 
-    if (fout == NULL) { perror(argv[3]); return 1; }
+    size_t h = (key * 2654435761u) & (m->cap - 1);
+    while (m->slot[h].n != 0 && m->slot[h].key != key) h = (h + 1) & (m->cap - 1);
+    if (m->slot[h].n == 0) { m->slot[h].key = key; m->cnt++; }
+    m->slot[h].n += n;
+}
+static void pair_add(PairMap *m, int prev, int cur){
+    pair_add_n(m, (unsigned)prev * CTX_SPAN + (unsigned)cur, 1);
+}
+static long long pair_get(const PairMap *m, unsigned key){
+    if (m->cap == 0) return 0;
+    size_t h = (key * 2654435761u) & (m->cap - 1);
+    while (m->slot[h].n != 0) {
+        if (m->slot[h].key == key) return m->slot[h].n;
+        h = (h + 1) & (m->cap - 1);
+    }
+    return 0;
+}
 
-    // === symbol statics ===
-    Symb symb[MAX_SYMB]={0};
-    
-    // initial ascii symbols
+// -------------- coded size of a histogram with its own table (bits) --------------
+// data: sum n*log2(T/n), table: one line per symbol with a code of about log2(T/n) chars
+static double hist_cost(const long long *h, int nsym){
+    long long t = 0;
+    for (int i = 0; i < nsym; i++) t += h[i];
+    double bits = 0.0;
+    for (int i = 0; i < nsym; i++) {
+        if (h[i] == 0) continue;
+        double info = log2((double)t / (double)h[i]);
+        bits += (double)h[i] * info + LINE_BITS + 8.0 * info;
+    }
+    return bits;
+}
+// cost change when clusters a and b share one table
+static double merge_delta(const long long *a, const long long *b, double ca, double cb, int nsym, long long *tmp){
+    for (int i = 0; i < nsym; i++) tmp[i] = a[i] + b[i];
+    return hist_cost(tmp, nsym) - ca - cb;
+}
+
+typedef struct {
+    int ctx;
+    long long n;
+} CtxCnt;
+static int cmp_ctx_desc(const void *a, const void *b){
+    const CtxCnt *x = (const CtxCnt*)a, *y = (const CtxCnt*)b;
+    if (x->n != y->n) return (x->n > y->n) ? -1 : 1;
+    return x->ctx - y->ctx;
+}
+
+// -------------- cluster contexts into at most ntab tables --------------
+// ctx_tab[context] = table, *hist_out = table histograms [tables][nsym]
+// return number of tables
+static int cluster_contexts(const PairMap *pm, int nsym, int ntab, int *ctx_tab, long long **hist_out){
+    // count of every context
+    CtxCnt *order = (CtxCnt*)calloc(CTX_SPAN, sizeof(CtxCnt));
+    for (int i = 0; i < CTX_SPAN; i++) order[i].ctx = i;
+    for (size_t i = 0; i < pm->cap; i++) {
+        if (pm->slot[i].n) order[pm->slot[i].key / CTX_SPAN].n += pm->slot[i].n;
+    }
+    qsort(order, CTX_SPAN, sizeof(CtxCnt), cmp_ctx_desc);
+    int nctx = 0;
+    while (nctx < CTX_SPAN && order[nctx].n > 0) nctx++;
+
+    // seed clusters: most frequent contexts alone, the rare rest together in the last one
+    int m = nctx < 2 * ntab ? nctx : 2 * ntab;
+    if (m == 0) m = 1;
+    int *clu = (int*)malloc(CTX_SPAN * sizeof(int)); // context -> seed cluster
+    for (int i = 0; i < CTX_SPAN; i++) clu[i] = -1;
+    for (int r = 0; r < nctx; r++) clu[order[r].ctx] = (r < m) ? r : m - 1;
+
+    long long *hist = (long long*)calloc((size_t)m * nsym, sizeof(long long));
+    long long *tmp = (long long*)malloc(nsym * sizeof(long long));
+    double *cost = (double*)malloc(m * sizeof(double));
+    double *delta = (double*)malloc((size_t)m * m * sizeof(double));
+    int *alias = (int*)malloc(m * sizeof(int)); // merged into, -1 = alive
+    for (size_t i = 0; i < pm->cap; i++) {
+        if (pm->slot[i].n) hist[(size_t)clu[pm->slot[i].key / CTX_SPAN] * nsym + pm->slot[i].key % CTX_SPAN] += pm->slot[i].n;
+    }
+    for (int a = 0; a < m; a++) { cost[a] = hist_cost(hist + (size_t)a * nsym, nsym); alias[a] = -1; }
+    for (int a = 0; a < m; a++)
+        for (int b = a + 1; b < m; b++)
+            delta[a * m + b] = merge_delta(hist + (size_t)a * nsym, hist + (size_t)b * nsym, cost[a], cost[b], nsym, tmp);
+
+    // greedy: merge the most similar pair, until ntab tables and no merge saves bits
+    int alive = m;
+    while (alive > 1) {
+        int ba = -1, bb = -1;
+        for (int a = 0; a < m; a++) {
+            if (alias[a] >= 0) continue;
+            for (int b = a + 1; b < m; b++) {
+                if (alias[b] >= 0) continue;
+                if (ba < 0 || delta[a * m + b] < delta[ba * m + bb]) { ba = a; bb = b; }
+            }
+        }
+        if (alive <= ntab && delta[ba * m + bb] > 0) break;
+        long long *ha = hist + (size_t)ba * nsym, *hb = hist + (size_t)bb * nsym;
+        for (int i = 0; i < nsym; i++) ha[i] += hb[i];
+        alias[bb] = ba;
+        alive--;
+        cost[ba] = hist_cost(ha, nsym);
+        for (int x = 0; x < m; x++) {
+            if (x == ba || alias[x] >= 0) continue;
+            int a = x < ba ? x : ba, b = x < ba ? ba : x;
+            delta[a * m + b] = merge_delta(hist + (size_t)a * nsym, hist + (size_t)b * nsym, cost[a], cost[b], nsym, tmp);
+        }
+    }
+
+    // number surviving clusters 0..k-1 and move their histograms to the front
+    int *id = (int*)malloc(m * sizeof(int));
+    int k = 0;
+    for (int a = 0; a < m; a++) {
+        if (alias[a] >= 0) continue;
+        if (k != a) memcpy(hist + (size_t)k * nsym, hist + (size_t)a * nsym, nsym * sizeof(long long));
+        id[a] = k++;
+    }
+    for (int c = 0; c < CTX_SPAN; c++) {
+        int a = clu[c];
+        if (a < 0) { ctx_tab[c] = 0; continue; } // context never seen
+        while (alias[a] >= 0) a = alias[a];
+        ctx_tab[c] = id[a];
+    }
+    free(order); free(clu); free(tmp); free(cost); free(delta); free(alias); free(id);
+    *hist_out = hist;
+    return k;
+}
+
+// -------------- build huffman codes of one context table --------------
+// code[c] = code string of symbol c (NULL if symbol not in table), return table symbols
+static Symb* build_table(const Symb *symb, const long long *h, int nsym, char **code){
+    int n = 0;
+    for (int c = 0; c < nsym; c++) if (h[c]) n++;
+    Symb *ts = (Symb*)calloc(n > 0 ? n : 1, sizeof(Symb));
+    Symb **nodes = (Symb**)malloc(2 * (n > 0 ? n : 1) * sizeof(Symb*));
+    int k = 0;
+    for (int c = 0; c < nsym; c++) {
+        code[c] = NULL;
+        if (h[c] == 0) continue;
+        memcpy(ts[k].chr, symb[c].chr, sizeof(ts[k].chr));
+        ts[k].useLen = symb[c].useLen;
+        ts[k].count = h[c];
+        ts[k].is_leaf = 1;
+        nodes[k] = &ts[k];
+        code[c] = ts[k].code;
+        k++;
+    }
+    if (n > 0) {
+        char code_buff[256];
+        generate_codes(build_huffman_tree(nodes, n), code_buff, 0); // one symbol: empty code
+    }
+    free(nodes);
+    return ts;
+}
+
+// ================== symbol statistics (one codebook) ==================
+Symb symb[MAX_SYMB];      // symbols, one byte symbols at their byte value
+int used = BYTE_MAX;      // used symbol types
+long long total = 0;      // total symbol count
+int eofIdx = -1;          // "EOF" symbol index
+int fullStored = 0;       // 1 = out of symbol types: keep counting bytes, the input is stored
+int symbFull = 0;         // symbol types ran out (with fullStored)
+int escIdx = -1;          // "ESC" symbol index (-s), symbol missing in sample follows as raw bytes
+int runIdx = -1;          // "RUN" symbol index (-r), -1 = no run yet
+int runMin = 0;           // -r: shortest run replaced by RUN + length, 0 = off
+long long runLenCnt[64];  // run length buckets (floor(log2(length)))
+char runLenCode[64][256]; // run length bucket codes
+int ntab = 0;             // -c: most context tables, 0 = single codebook
+PairMap pairs;            // (previous, current) counts for -c
+long long eofAfter[CTX_SPAN]; // -c: symbol before EOF (EOF index known after counting)
+int nt = 0;               // context tables in use
+int ctx_tab[CTX_SPAN];    // context -> table
+char **tcode[MAX_TABLES]; // [table][symbol] -> code string
+Symb *tsymb[MAX_TABLES];  // table symbols (own the code strings)
+
+// -------------- initial ascii symbols --------------
+static void init_symbols(void){
     for(int i=0;i<=0x7F;i++){ 
         symb[i].chr[0]=(unsigned char)i; 
         symb[i].useLen=1; 
         symb[i].count=0; // start from zero
     }
+}
 
-    int used = BYTE_MAX;  // used symbol types
-    int total = 0;        // total symbol count
-    int c; // a byte read from file
+// -------------- add a special symbol ("EOF", "RUN") --------------
+static int add_special(const char *name){
+    if (used >= MAX_SYMB) { fprintf(stderr, "symbols are too many (%d)!\n", used); exit(1); }
+    memcpy(symb[used].chr, name, 3);
+    symb[used].useLen = 3;
+    symbol_insert(symb, used);
+    return used++;
+}
 
-    // ---------------------- statistic symbol --------------------
-    while((c=fgetc(fin))!=EOF){
-        unsigned char b0 = (unsigned char)c; 
-        // handle ascii 0~127
-        if(b0 <= 0x7F){ 
-            symb[b0].count++;
-            total++;
-            continue; // next char
-        }
-
-        // handle multibyte symbol (utf-8 / big5)
-        int symbLen=1; 
-        unsigned char tmp[4]; //store symbol following bytes
-        tmp[0]=b0; // first byte
-        int uLen=0; // symbol use length (bytes)
-        int read=1, ok=0; 
-
-        // try utf-8
-        uLen = utf8_len(b0); // check is legal utf-8 first byte & length
-        if(uLen > 1){
-            ok = 1;
-            for(int i=1;i<uLen;i++){
-                int d=fgetc(fin);
-                if(d==EOF){ ok=0; break; } // end of file break
-                tmp[read++]=(unsigned char)d; // store symbol in tmp[] (2~4 bytes)
-                if(!is_utf8_follow(tmp[read-1])){ ok=0; break; } // illegal following utf-8 byte
-            }
+// -------------- symbol index, add = 1: new symbols are added --------------
+static int symbol_add(const unsigned char *tmp, int symbLen, int add){
+    int idx = symbol_index(symb, tmp, symbLen);
+    if (idx >= 0 && symb[idx].useLen == 0 && add) {
+        // unknown one byte symbol (128~255), first time seen initialize
+        symb[idx].useLen = 1;
+        symb[idx].chr[0] = tmp[0];
+    }
+    if (idx < 0 && add) {
+        // not found, add new symbol
+        // check symbol limit
+        if (used >= MAX_SYMB - SPECIAL_ROOM && fullStored) { symbFull = 1; return tmp[0]; } // binary: stored anyway
+        if(used >= MAX_SYMB - SPECIAL_ROOM) { fprintf(stderr, "symbols are too many (%d)!\n", used); exit(1); }
+        memcpy(symb[used].chr, tmp, symbLen); // copy symbol bytes
+        symb[used].useLen = symbLen; // set symbol length
+        symbol_insert(symb, used);
+        idx = used++; // push back used symbol types
+    }
+    return idx;
+}
+
+// -------------- read next single character symbol index --------------
+// add = 1: new symbols are added (counting pass), return -1 at end of file
+static int next_base(InStream *in, int add){
+    unsigned char tmp[4]; // bytes of one symbol
+    int symbLen;
+    switch (charset) {
+    case CS_ASCII: symbLen = read_ascii(in, tmp); break;
+    case CS_UTF8:  symbLen = read_utf8(in, tmp); break;
+    case CS_BIG5:  symbLen = read_big5(in, tmp); break;
+    default:       symbLen = read_mixed(in, tmp); break;
+    }
+    if (symbLen == 0) return -1;
+    return symbol_add(tmp, symbLen, add);
+}
+
+// ================== multi-character tokens (-m) ==================
+// the most frequent neighbour pairs are merged into one token (byte pair encoding),
+// learned on the start of the input, then the input is split by longest token match.
+// tokens are plain codebook symbols, the decoder writes them like any other symbol
+#define MAX_MERGES      2048      // most merged tokens
+#define LEARN_SYMBOLS   (1 << 18) // symbols at the start of input to learn merges from
+#define MERGE_BATCH     32        // most merges per pass over the sample
+#define MIN_MERGE_COUNT 8         // rarer pairs don't pay for their codebook line
+#define TRIE_NODE       MAX_SYMB  // first inner trie node, nodes below are single symbols
+
+int nmerge = 0;            // -m: most merged tokens, 0 = off
+PairMap trie;              // (trie node, symbol) -> child node + 1
+int *trieTok = NULL;       // [node - TRIE_NODE] -> token ending here, -1 = none
+int trieNodes = 0;
+short tokSeq[MAX_SYMB][MAX_TOKEN_LEN]; // single character symbols of a token
+int tokSeqLen[MAX_SYMB];               // 0 = not a token (the symbol itself)
+int baseQ[MAX_TOKEN_LEN];  // symbols read ahead for matching
+int nq = 0;
+
+// -------------- symbol can be part of a token --------------
+// no specials and no bytes with a csv escape ("\n", "\\") in the codebook
+static int plain_symbol(int idx){
+    if (idx == eofIdx || idx == runIdx || idx == escIdx) return 0;
+    for (int i = 0; i < symb[idx].useLen; i++) {
+        unsigned char c = symb[idx].chr[i];
+        if (c < 0x20 || c == 0x7F || c == '\\') return 0;
+    }
+    return 1;
+}
+
+// -------------- add token a + b, return its index or -1 --------------
+static int add_token(int a, int b){
+    int la = symb[a].useLen, lb = symb[b].useLen;
+    int sa = tokSeqLen[a] ? tokSeqLen[a] : 1, sb = tokSeqLen[b] ? tokSeqLen[b] : 1;
+    if (la + lb > MAX_TOKEN_LEN || used >= MAX_SYMB - 512) return -1; // room for symbols seen later
+    unsigned char tmp[MAX_TOKEN_LEN];
+    memcpy(tmp, symb[a].chr, la);
+    memcpy(tmp + la, symb[b].chr, lb);
+    // same bytes as another symbol or a special name would be ambiguous in the codebook
+    if (symbol_index(symb, tmp, la + lb) >= 0) return -1;
+    if (la + lb == 3 && (memcmp(tmp, "EOF", 3) == 0 || memcmp(tmp, "RUN", 3) == 0 || memcmp(tmp, "ESC", 3) == 0)) return -1;
+
+    int t = used++;
+    memcpy(symb[t].chr, tmp, la + lb);
+    symb[t].useLen = la + lb;
+    symbol_insert(symb, t);
+    short *seq = tokSeq[t];
+    if (tokSeqLen[a]) memcpy(seq, tokSeq[a], sa * sizeof(short)); else seq[0] = (short)a;
+    if (tokSeqLen[b]) memcpy(seq + sa, tokSeq[b], sb * sizeof(short)); else seq[sa] = (short)b;
+    tokSeqLen[t] = sa + sb;
+
+    // trie path: first symbol, then one edge per following symbol
+    int node = seq[0];
+    for (int i = 1; i < sa + sb; i++) {
+        unsigned key = (unsigned)node * CTX_SPAN + (unsigned)seq[i];
+        long long ch = pair_get(&trie, key);
+        if (ch == 0) {
+            trieTok = (int*)realloc(trieTok, (trieNodes + 1) * sizeof(int));
+            if (trieTok == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+            trieTok[trieNodes] = -1;
+            ch = TRIE_NODE + trieNodes++ + 1;
+            pair_add_n(&trie, key, ch);
         }
-        if (ok){ 
-            symbLen = uLen; // save utf-8 length
-        } else { 
-            for (int j=read-1;j>=1; --j) ungetc(tmp[j], fin); // push back to b0
-        }
-
-        // try big-5
-        if (symbLen == 1){  // check not utf-8 (symbLen unchanged)
-            uLen = big5_len(b0); // check is legal big-5 first byte & length
-            if (uLen == 2){ 
-                int d = fgetc(fin); // read following byte (second byte)
-                if (d != EOF && is_big5_follow((unsigned char)d)){ // legal big-5 follow byte
-                    tmp[1] = (unsigned char)d;
-                    symbLen = 2;   // big-5 always 2 bytes
-                } else {
-                    if (d != EOF) ungetc(d, fin); // push back to b0
-                }
-            }
+        node = (int)ch - 1;
+    }
+    trieTok[node - TRIE_NODE] = t;
+    return t;
+}
+
+static int cmp_pair_desc(const void *a, const void *b){
+    const PairCnt *x = (const PairCnt*)a, *y = (const PairCnt*)b;
+    if (x->n != y->n) return (x->n > y->n) ? -1 : 1;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+// -------------- learn merges from the start of input, then rewind --------------
+static void learn_tokens(InStream *in){
+    int *seq = (int*)malloc(LEARN_SYMBOLS * sizeof(int));
+    if (seq == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    int n = 0, idx;
+    while (n < LEARN_SYMBOLS && (idx = next_base(in, 1)) >= 0) seq[n++] = idx;
+
+    int made = 0;
+    while (made < nmerge) {
+        // neighbour pair counts, best first
+        PairMap pm = {0};
+        for (int i = 1; i < n; i++) {
+            if (plain_symbol(seq[i-1]) && plain_symbol(seq[i])) pair_add(&pm, seq[i-1], seq[i]);
         }
+        size_t np = 0;
+        for (size_t i = 0; i < pm.cap; i++) if (pm.slot[i].n) pm.slot[np++] = pm.slot[i];
+        if (np > 0) qsort(pm.slot, np, sizeof(PairCnt), cmp_pair_desc); // slot is NULL without pairs
 
-        // handle non ASCII, UTF-8, Big-5 symbols (128~255)
-        if (symbLen == 1){ // symbleLen unchanged -> unknown one byte symbol
-            if (symb[b0].useLen == 0){  // first time seen initialize
-                symb[b0].useLen = 1;
-                symb[b0].chr[0] = b0;
-            }
-            symb[b0].count++; // count this symbol 
-            total++; // count total symbols
-            continue;
-        }
-
-        // save multibyte symbol (utf-8 / big5)
-        int found=0;
-        for(int i=BYTE_MAX;i<used;i++){ 
-            // find existing symbol
-            if(symb[i].useLen==symbLen && memcmp(symb[i].chr,tmp,symbLen)==0){ 
-                symb[i].count++; // count this symbol
-                found=1; // mark found
-                total++;
-                break; 
+        // a batch of pairs about as frequent as the best one, one sweep replaces them all.
+        // first merges one at a time, they change the pair counts the most
+        PairMap sel = {0}; // pair -> token + 1
+        int batch = 0, most = 1 + made / 8;
+        if (most > MERGE_BATCH) most = MERGE_BATCH;
+        for (size_t i = 0; i < np && batch < most && made < nmerge; i++) {
+            if (pm.slot[i].n < MIN_MERGE_COUNT || 2 * pm.slot[i].n < pm.slot[0].n) break;
+            int a = pm.slot[i].key / CTX_SPAN, b = pm.slot[i].key % CTX_SPAN;
+            int t = add_token(a, b);
+            if (t < 0) continue;
+            pair_add_n(&sel, pm.slot[i].key, t + 1);
+            batch++;
+            made++;
+        }
+        free(pm.slot);
+        if (batch == 0) break;
+
+        // replace the chosen pairs in the sample
+        int j = 0;
+        for (int i = 0; i < n; i++) {
+            long long t = (i + 1 < n) ? pair_get(&sel, (unsigned)seq[i] * CTX_SPAN + (unsigned)seq[i+1]) : 0;
+            if (t) { seq[j++] = (int)t - 1; i++; }
+            else seq[j++] = seq[i];
+        }
+        n = j;
+        free(sel.slot);
+    }
+    free(seq);
+    in_rewind(in);
+}
+
+// -------------- read next symbol index (longest token match) --------------
+static int next_index(InStream *in, int add){
+    if (trie.cnt == 0) return next_base(in, add);
+    if (nq == 0) {
+        if ((baseQ[0] = next_base(in, add)) < 0) return -1;
+        nq = 1;
+    }
+    int best = baseQ[0], blen = 1, node = baseQ[0];
+    for (int i = 1; i < MAX_TOKEN_LEN; i++) {
+        if (i == nq) { // read one more symbol ahead
+            int b = next_base(in, add);
+            if (b < 0) break;
+            baseQ[nq++] = b;
+        }
+        long long ch = pair_get(&trie, (unsigned)node * CTX_SPAN + (unsigned)baseQ[i]);
+        if (ch == 0) break;
+        node = (int)ch - 1;
+        if (trieTok[node - TRIE_NODE] >= 0) { best = trieTok[node - TRIE_NODE]; blen = i + 1; }
+    }
+    nq -= blen;
+    memmove(baseQ, baseQ + blen, nq * sizeof(int));
+    return best;
+}
+
+// -------------- read next symbol and how often it repeats --------------
+// with -r equal symbols in a row come back as one symbol, *k = repeat count
+int pendingIdx = -1; // symbol read ahead to find the end of a run
+static int next_run(InStream *in, int add, long long *k){
+    int idx = (pendingIdx >= 0) ? pendingIdx : next_index(in, add);
+    pendingIdx = -1;
+    *k = 1;
+    if (idx < 0 || runMin == 0) return idx;
+    int nx;
+    while ((nx = next_index(in, add)) == idx) (*k)++;
+    pendingIdx = nx; // -1 at end of file
+    return idx;
+}
+
+// -------------- run length -> bucket, length = 1bbbb (bucket = number of b bits) --------------
+static int run_bucket(long long len){
+    int b = 0;
+    while ((len >> (b + 1)) != 0) b++;
+    return b;
+}
+
+// -------------- counting pass --------------
+static void count_symbol(int prev, int idx){
+    symb[idx].count++; // count this symbol
+    total++; // count total symbols
+    if (ntab > 0) pair_add(&pairs, prev, idx);
+}
+// single codebook, no runs / tokens: ascii bytes are counted straight from the input block
+static void count_plain(InStream *in){
+    int idx;
+    for (;;) {
+        long long n = 0;
+        while (in->nback == 0 && in->pos < in->len && in->buf[in->pos] <= 0x7F) {
+            symb[in->buf[in->pos++]].count++;
+            n++;
+        }
+        total += n;
+        if ((idx = next_base(in, 1)) < 0) break;
+        symb[idx].count++;
+        total++;
+    }
+}
+static void count_input(InStream *in){
+    int prev = CTX_START; // previous symbol index
+    long long k;
+    int idx;
+    if (ntab == 0 && runMin == 0 && nmerge == 0) { count_plain(in); return; }
+    while ((idx = next_run(in, 1, &k)) >= 0) {
+        if (runMin > 0 && k >= runMin) {
+            // symbol once, then RUN with repeat count (context stays the symbol)
+            if (runIdx < 0) runIdx = add_special("RUN");
+            count_symbol(prev, idx);
+            count_symbol(idx, runIdx);
+            runLenCnt[run_bucket(k - 1)]++;
+        } else {
+            count_symbol(prev, idx);
+            for (long long j = 1; j < k; j++) count_symbol(idx, idx);
+        }
+        prev = idx;
+    }
+    eofAfter[prev]++; // EOF follows the last symbol
+}
+
+// ================== sampled statistics (-s) ==================
+// counts come from chunks spread over the input, symbols the sample missed
+// are coded as ESC, 4 bits length - 1, then the symbol bytes
+#define SAMPLE_CHUNKS   16         // chunks per sample
+
+long long sampleBytes = 0;         // -s: sample size, 0 = count everything
+int sampled = 0;                   // codebook is from a sample
+long long seen[MAX_SYMB];          // symbols of the encoding pass (ratio report)
+
+// -------------- input size, -1 if not seekable --------------
+static long long input_size(FILE *fp){
+    if (fseeko(fp, 0, SEEK_END) != 0) return -1;
+    long long size = (long long)ftello(fp);
+    rewind(fp);
+    return size;
+}
+
+// -------------- count symbols of SAMPLE_CHUNKS chunks --------------
+static void count_sample(InStream *in, long long size){
+    long long chunk = sampleBytes / SAMPLE_CHUNKS;
+    int prev = CTX_START;
+    for (int k = 0; k < SAMPLE_CHUNKS; k++) {
+        in_seek(in, size / SAMPLE_CHUNKS * k);
+        nq = 0;
+        if (k > 0) { // start at a symbol: skip utf-8 follow bytes
+            int c;
+            while ((c = in_getc(in)) != EOF && is_utf8_follow((unsigned char)c)) ;
+            if (c != EOF) in_ungetc(in, c);
+        }
+        long long got = 0;
+        int idx;
+        while (got < chunk && (idx = next_index(in, 1)) >= 0) {
+            count_symbol(prev, idx);
+            got += symb[idx].useLen;
+            prev = idx;
+        }
+    }
+    nq = 0;
+}
+
+// -------------- payload of the sample codebook against counting everything --------------
+static void report_sample(unsigned long long bits){
+    static long long h[MAX_SYMB];
+    static char *code[MAX_SYMB];
+    memcpy(h, seen, sizeof(h));
+    h[escIdx] = 0;
+    h[eofIdx] = 1;
+    Symb *ts = build_table(symb, h, used, code);
+    unsigned long long full = 0;
+    for (int i = 0; i < used; i++) if (code[i]) full += (unsigned long long)h[i] * strlen(code[i]);
+    free(ts);
+    fprintf(stderr, "sampled statistics: payload %llu bytes, counting all input %llu bytes (%+.2f%%)\n",
+            (bits + 7) / 8, (full + 7) / 8, full ? 100.0 * ((double)bits - (double)full) / (double)full : 0.0);
+}
+
+// ================== ascii pair fast path ==================
+// single codebook, no runs / tokens / sample: two ascii bytes straight from the
+// input block, one table lookup and one bit write for both codes
+#define PAIR_MAX_BITS   56         // longest pair code in the table
+
+typedef struct {
+    uint64_t bits;   // code, low aligned
+    int len;         // code length, -1 = not packed (too long or symbol not in codebook)
+} PackedCode;
+
+PackedCode symCode[MAX_SYMB];      // code of every symbol
+PackedCode pairCode[128 * 128];    // [b0 << 7 | b1] codes of two ascii symbols
+
+// -------------- code strings -> packed codes and the pair table --------------
+static void pack_codes(void){
+    for (int i = 0; i < used; i++) {
+        int len = strlen(symb[i].code);
+        uint64_t v = 0;
+        for (int k = 0; k < len && k < 64; k++) v = (v << 1) | (uint64_t)(symb[i].code[k] - '0');
+        symCode[i].bits = v;
+        symCode[i].len = (len > 64 || (symb[i].count == 0 && i != eofIdx)) ? -1 : len;
+    }
+    for (int a = 0; a < 128; a++) {
+        for (int b = 0; b < 128; b++) {
+            PackedCode *p = &pairCode[a << 7 | b];
+            int la = symCode[a].len, lb = symCode[b].len;
+            p->len = (la < 0 || lb < 0 || la + lb > PAIR_MAX_BITS) ? -1 : la + lb;
+            if (p->len >= 0) p->bits = (symCode[a].bits << lb) | symCode[b].bits;
+        }
+    }
+}
+
+// -------------- write n bits of v (n <= PAIR_MAX_BITS), several at a time --------------
+static inline void put_bits(uint64_t v, int n, OutStream *out){
+    uint64_t acc = ((uint64_t)byteBuffer << n) | v; // bitInBuff (< 8) pending bits first
+    int cnt = bitInBuff + n;
+    while (cnt >= 8) {
+        cnt -= 8;
+        out_putc(out, (unsigned char)(acc >> cnt));
+    }
+    byteBuffer = (unsigned char)(acc & ((1u << cnt) - 1));
+    bitInBuff = cnt;
+}
+
+// -------------- encoding pass of a plain codebook --------------
+static unsigned long long encode_plain(InStream *in, OutStream *out){
+    unsigned long long bits = 0;
+    for (;;) {
+        if (in->nback == 0 && in->pos + 1 < in->len) {
+            unsigned char b0 = in->buf[in->pos], b1 = in->buf[in->pos + 1];
+            const PackedCode *pc = &pairCode[(b0 << 7 | b1) & 0x3FFF];
+            if ((b0 | b1) < 0x80 && pc->len >= 0) { // two ascii symbols
+                put_bits(pc->bits, pc->len, out);
+                bits += pc->len;
+                in->pos += 2;
+                continue;
             }
         }
+        int idx = next_index(in, 0);
+        if (idx < 0) break;
+        if (symCode[idx].len >= 0 && symCode[idx].len <= PAIR_MAX_BITS) put_bits(symCode[idx].bits, symCode[idx].len, out);
+        else write_code(symb[idx].code, strlen(symb[idx].code), out);
+        bits += strlen(symb[idx].code);
+    }
+    return bits;
+}
 
-        // not found, add new symbol
-        if(!found){ 
-            // check symbol limit
-            if(used >= MAX_SYMB) { fprintf(stderr, "symbols are too many (%d)!\n", used); return 1; }
-            memcpy(symb[used].chr, tmp, symbLen); // copy symbol bytes
-            symb[used].useLen = symbLen; // set symbol length
-            symb[used].count = 1; // initialize count
-            total++; 
-            used++; // push back used symbol types
+// ================== tANS backend (-e) ==================
+// same symbol counts, normalized to a table of 1 << ansLog states; symbols are
+// coded backwards in blocks so the decoder reads each block forwards
+#define ANS_BLOCK       (1 << 20)  // symbols per block
+#define ANS_MIN_LOG     11         // smallest table tried, up to ANS_MAX_LOG
+
+enum { BK_HUFF, BK_ANS, BK_AUTO };
+int backend = BK_HUFF;             // -e
+int useAns = 0;                    // payload is tANS
+int ansLog = 0;
+int ansN = 0;                      // symbols in the table (codebook line order)
+int ansFreq[MAX_SYMB];             // normalized counts, codebook order
+int ansNb[MAX_SYMB];               // ansLog - floor(log2(freq)), bits to write (or one less)
+int ansCum[MAX_SYMB];              // first ansEnc slot of each symbol
+int ansPos[MAX_SYMB];              // symbol index -> codebook order
+uint32_t *ansEnc = NULL;           // [cum + sub state - freq] -> next state
+
+// -------------- cost change of one more (d = 1) / one less (d = -1) state --------------
+static double ans_gain(long long cnt, int f, int d){
+    return (double)cnt * log((double)(f + d) / f);
+}
+
+// -------------- counts -> freq summing to 1 << log, return estimated symbol bits --------------
+static double ans_normalize(Symb **list, int n, long long cnt, int log2L, int *freq){
+    int L = 1 << log2L, sum = 0;
+    // scale, at least one state each, then move single states where they cost least
+    for (int s = 0; s < n; s++) {
+        freq[s] = (int)((double)list[s]->count * L / cnt);
+        if (freq[s] < 1) freq[s] = 1;
+        sum += freq[s];
+    }
+    while (sum != L) {
+        int d = sum < L ? 1 : -1, best = -1;
+        double bg = 0;
+        for (int s = 0; s < n; s++) {
+            if (d < 0 && freq[s] == 1) continue;
+            double g = ans_gain(list[s]->count, freq[s], d);
+            if (best < 0 || g > bg) { best = s; bg = g; }
         }
+        freq[best] += d;
+        sum += d;
     }
+    double est = 0;
+    for (int s = 0; s < n; s++) est += (double)list[s]->count * log((double)L / freq[s]) / log(2.0);
+    return est;
+}
+
+// -------------- codebook csv and encode table, return estimated payload bits --------------
+static unsigned long long build_ans(StrBuf *csv){
+    static Symb *list[MAX_SYMB];
+    static int freq[MAX_SYMB];
+    long long cnt = 0;
+    ansN = 0;
+    for (int i = 0; i < used; i++) {
+        if (symb[i].count > 0 && i != eofIdx) { list[ansN++] = &symb[i]; cnt += symb[i].count; }
+    }
+    qsort(list, ansN, sizeof(Symb*), cmp_codebook);
+    // table size with the fewest bits (bigger tables follow rare symbols closer)
+    double est = -1;
+    for (int lg = ANS_MIN_LOG; lg <= ANS_MAX_LOG; lg++) {
+        if ((1 << lg) < ansN) continue;
+        double e = ans_normalize(list, ansN, cnt, lg, freq);
+        if (est < 0 || e < est) {
+            est = e;
+            ansLog = lg;
+            memcpy(ansFreq, freq, ansN * sizeof(int));
+        }
+    }
+    int L = 1 << ansLog;
+
+    sb_printf(csv, "#ans,%d\n", ansLog);
+    est += 32.0 * ((cnt + ANS_BLOCK - 1) / ANS_BLOCK + 1) + ansLog;
+    for (int s = 0; s < ansN; s++) {
+        Symb *p = list[s];
+        p->prob = (double)p->count / (double)total;
+        ansPos[p - symb] = s;
+        csv_char(p->chr, p->useLen, csv);
+        sb_printf(csv, ",%lld,%.15f,%d,%.15f\n", p->count, p->prob, ansFreq[s], -log(p->prob) / log(2.0));
+    }
+
+    // encode table in the decoder's state order
+    uint16_t *spread = (uint16_t*)malloc(L * sizeof(uint16_t));
+    int *next = (int*)malloc((ansN + 1) * sizeof(int));
+    free(ansEnc);
+    ansEnc = (uint32_t*)malloc(L * sizeof(uint32_t));
+    if (!spread || !next || !ansEnc) { fprintf(stderr, "out of memory\n"); exit(1); }
+    for (int s = 0, c = 0; s < ansN; s++) {
+        ansCum[s] = c;
+        c += ansFreq[s];
+        next[s] = ansFreq[s];
+        ansNb[s] = ansLog - floor_log2((uint32_t)ansFreq[s]);
+    }
+    ans_spread(ansFreq, ansN, ansLog, spread);
+    for (int x = 0; x < L; x++) {
+        int s = spread[x];
+        ansEnc[ansCum[s] + next[s]++ - ansFreq[s]] = (uint32_t)(x + L);
+    }
+    free(spread);
+    free(next);
+    return (unsigned long long)est;
+}
 
+// -------------- one block: count, start state, then bits in decoding order --------------
+static unsigned long long ans_block(const int *sym, int n, uint32_t *val, uint8_t *nbits, OutStream *out){
+    uint32_t L = 1u << ansLog, x = L; // state in [L, 2L)
+    for (int i = n - 1; i >= 0; i--) {
+        int s = sym[i], f = ansFreq[s], nb = ansNb[s];
+        if ((int)(x >> nb) < f) nb--; // sub state x >> nb in [f, 2f)
+        val[i] = x & ((1u << nb) - 1);
+        nbits[i] = (uint8_t)nb;
+        x = ansEnc[ansCum[s] + (x >> nb) - f];
+    }
+    unsigned long long bits = 32 + ansLog;
+    put_bits((uint64_t)n, 32, out);
+    put_bits(x - L, ansLog, out);
+    for (int i = 0; i < n; i++) {
+        put_bits(val[i], nbits[i], out);
+        bits += nbits[i];
+    }
+    return bits;
+}
+
+// -------------- encoding pass with the tANS table --------------
+static unsigned long long encode_ans(InStream *in, OutStream *out){
+    int *sym = (int*)malloc(ANS_BLOCK * sizeof(int));
+    uint32_t *val = (uint32_t*)malloc(ANS_BLOCK * sizeof(uint32_t));
+    uint8_t *nbits = (uint8_t*)malloc(ANS_BLOCK);
+    if (!sym || !val || !nbits) { fprintf(stderr, "out of memory\n"); exit(1); }
+    unsigned long long bits = 32;
+    int n = 0, idx;
+    while ((idx = next_index(in, 0)) >= 0) {
+        sym[n++] = ansPos[idx];
+        if (n == ANS_BLOCK) { bits += ans_block(sym, n, val, nbits, out); n = 0; }
+    }
+    if (n > 0) bits += ans_block(sym, n, val, nbits, out);
+    put_bits(0, 32, out); // end of blocks
+    if (bitInBuff > 0) {
+        out_putc(out, (unsigned char)(byteBuffer << (8 - bitInBuff)));
+        bitInBuff = 0;
+        byteBuffer = 0;
+    }
+    free(sym);
+    free(val);
+    free(nbits);
+    return bits;
+}
+
+// -------------- stored frame: the counted bytes again, block by block --------------
+// at most n bytes (input that grew since counting doesn't break the frame), return bytes
+static unsigned long long copy_input(InStream *in, OutStream *out, unsigned long long n){
+    unsigned long long done = 0;
+    while (done < n && (in->pos < in->len || in_refill(in))) {
+        size_t k = in->len - in->pos;
+        if (k > n - done) k = (size_t)(n - done);
+        out_write(out, in->buf + in->pos, k);
+        in->pos += k;
+        done += k;
+    }
+    return done;
+}
+
+// -------------- code of symbol idx after symbol prev --------------
+static const char* code_of(int prev, int idx){
+    return (nt > 0) ? tcode[ctx_tab[prev]][idx] : symb[idx].code;
+}
+
+// -------------- encoding pass --------------
+// return payload bits
+static unsigned long long encode_input(InStream *in, OutStream *out){
+    int prev = CTX_START;
+    long long k;
+    int idx;
+    unsigned long long bits = 0;
+    int plain = nt == 0 && runMin == 0 && nmerge == 0 && !sampled;
+    if (plain) {
+        pack_codes();
+        bits = encode_plain(in, out);
+    }
+    while (!plain && (idx = next_run(in, sampled, &k)) >= 0) {
+        if (sampled) {
+            seen[idx]++;
+            if (symb[idx].count == 0) { // not in sample: ESC, length, raw bytes
+                const char *ec = symb[escIdx].code;
+                write_code(ec, strlen(ec), out);
+                write_bits((unsigned long long)(symb[idx].useLen - 1), 4, out);
+                for (int i = 0; i < symb[idx].useLen; i++) write_bits(symb[idx].chr[i], 8, out);
+                bits += strlen(ec) + 4 + 8 * symb[idx].useLen;
+                continue;
+            }
+        }
+        const char *code = code_of(prev, idx);
+        int len = strlen(code);
+        write_code(code, len, out);
+        bits += len;
+        if (runMin > 0 && k >= runMin) {
+            // RUN code, length bucket code, bits of length below the top bit
+            const char *rc = code_of(idx, runIdx);
+            write_code(rc, strlen(rc), out);
+            int b = run_bucket(k - 1);
+            write_code(runLenCode[b], strlen(runLenCode[b]), out);
+            write_bits((unsigned long long)(k - 1), b, out);
+        } else if (k > 1) {
+            const char *rep = code_of(idx, idx);
+            int rlen = strlen(rep);
+            for (long long j = 1; j < k; j++) write_code(rep, rlen, out);
+        }
+        prev = idx;
+    }
+    // ---------------- end of input file -----------------------
+    const char *eof_code = code_of(prev, eofIdx);
+    write_code(eof_code, strlen(eof_code), out); // write EOF code
+    bits += strlen(eof_code);
+    if (bitInBuff> 0) {
+        // add 0 to fill last byte
+        byteBuffer <<= (8 - bitInBuff);
+        out_putc(out, byteBuffer); // last byte
+        bitInBuff = 0;
+        byteBuffer = 0;
+    }
+    return bits;
+}
+
+// -------------- build codebook csv, return payload size in bits --------------
+static unsigned long long build_codebook(StrBuf *csv){
     // ------------------ build huffman tree & generate codebook --------------------
     // add EOF symbol at the end
-    if (used < MAX_SYMB) {
-        strcpy((char*)symb[used].chr, "EOF"); // symbol "EOF"
-        symb[used].useLen = 3;                // length 3
-        symb[used].count = 1;                 // count 1
-        symb[used].is_leaf = 1;               // leaf node
-        symb[used].prob = 0.0;                // probability 0    
-        used++; // used symbol types +1
+    eofIdx = add_special("EOF");          // symbol "EOF"
+    symb[eofIdx].count = 1;               // count 1
+    symb[eofIdx].is_leaf = 1;             // leaf node
+    symb[eofIdx].prob = 0.0;              // probability 0    
+    if (sampled) { // escape for symbols the sample missed
+        escIdx = add_special("ESC");
+        symb[escIdx].count = 1;
+    }
+    if (ntab > 0) { // (previous, EOF) pairs
+        for (int c = 0; c < CTX_SPAN; c++) {
+            if (eofAfter[c]) pair_add_n(&pairs, (unsigned)c * CTX_SPAN + eofIdx, eofAfter[c]);
+        }
     }
 
     // prepare nodes array for building huffman tree (count > 0)
     // bigger array to hold all nodes including parents
-    Symb *nodes[MAX_SYMB * 2]; 
+    static Symb *nodes[MAX_SYMB * 2]; 
     int active_cnt = 0; // current active node count
 
     // collect all symbols with count > 0 to nodes[]
@@ -322,7 +1197,7 @@ int main(int argc, char *argv[]) {
     generate_codes(root, code_buff, 0);
 
     // output codebook to csv file
-    Symb *sorted_nodes[MAX_SYMB]; // array to hold pointers for sorting
+    static Symb *sorted_nodes[MAX_SYMB]; // array to hold pointers for sorting
     int output_cnt = 0;
 
     for(int i = 0; i < used; i++) {
@@ -336,8 +1211,8 @@ int main(int argc, char *argv[]) {
     // sorting sorted_nodes[] array
     qsort(sorted_nodes, output_cnt, sizeof(Symb*), cmp_codebook);
 
-    Symb *eof_symb = &symb[used-1]; 
-    fprintf(fcsv, "\"EOF\",0,0.000000000000000,%s,0.000000000000000\n", eof_symb->code);
+    Symb *eof_symb = &symb[eofIdx]; 
+    sb_printf(csv, "\"EOF\",0,0.000000000000000,%s,0.000000000000000\n", eof_symb->code);
 
     // output csv 
     for(int i = 0; i < output_cnt; i++) {
@@ -347,7 +1222,7 @@ int main(int argc, char *argv[]) {
         if (s == eof_symb) continue;
 
         // probability
-        if (total > 0) s->prob = (double)s->count / total;
+        if (total > 0) s->prob = (double)s->count / (double)total;
         else s->prob = 0.0;
         
         // self-information
@@ -357,82 +1232,882 @@ int main(int argc, char *argv[]) {
         }
 
         // normal output
-        csv_char(s->chr, s->useLen, fcsv); 
-        fprintf(fcsv, ",%ld,%.15f,%s,%.15f\n", s->count, s->prob, s->code, self_info);
+        csv_char(s->chr, s->useLen, csv); 
+        sb_printf(csv, ",%lld,%.15f,%s,%.15f\n", s->count, s->prob, s->code, self_info);
     }
-    fclose(fcsv);
 
-    // ------------------ encode input file -----------------------
-    rewind(fin); // reset file pointer to beginning
-    while((c=fgetc(fin))!=EOF){
-        unsigned char b0 = (unsigned char)c; 
-        // 1. handle ascii 0~127
-        if(b0 <= 0x7F){ 
-            // count++ -> write_code
-            write_code(symb[b0].code, strlen(symb[b0].code), fout); 
-            continue; 
-        }
-
-        // 2. handle multibyte symbol (utf-8 / big5) !! same as above !!
-        int symbLen=1; 
-        unsigned char tmp[4];
-        tmp[0]=b0;
-        int uLen=0;
-        int read=1, ok=0; 
-
-        uLen = utf8_len(b0); 
-        if(uLen > 1){
-            ok = 1;
-            for(int i=1;i<uLen;i++){
-                int d=fgetc(fin);
-                if(d==EOF){ ok=0; break; } 
-                tmp[read++]=(unsigned char)d; 
-                if(!is_utf8_follow(tmp[read-1])){ ok=0; break; } 
-            }
+    // payload size is known from counts: sum of count * code length + EOF code
+    unsigned long long bits = strlen(eof_symb->code);
+    for (int i = 0; i < output_cnt; i++) {
+        if (sorted_nodes[i] != eof_symb) bits += (unsigned long long)sorted_nodes[i]->count * strlen(sorted_nodes[i]->code);
+    }
+
+    // ------------------ run lengths: own huffman table after "#runlen" --------------------
+    unsigned long long run_bits = 0;
+    StrBuf runcsv = {0};
+    if (runIdx >= 0) {
+        Symb lsymb[64] = {0}; // bucket number as symbol text
+        char *lcode[64];
+        for (int b = 0; b < 64; b++) lsymb[b].useLen = sprintf((char*)lsymb[b].chr, "%d", b);
+        Symb *ts = build_table(lsymb, runLenCnt, 64, lcode);
+        sb_puts(&runcsv, "#runlen\n");
+        for (int b = 0; b < 64; b++) {
+            if (lcode[b] == NULL) continue;
+            strcpy(runLenCode[b], lcode[b]);
+            sb_printf(&runcsv, "\"%d\",%lld,0,%s,0\n", b, runLenCnt[b], lcode[b]);
+            run_bits += (unsigned long long)runLenCnt[b] * (strlen(lcode[b]) + b);
         }
-        if (ok){ 
-            symbLen = uLen; 
-        } else { 
-            for (int j=read-1;j>=1; --j) ungetc(tmp[j], fin); 
-        }
-
-        if (symbLen == 1){ 
-            uLen = big5_len(b0); 
-            if (uLen == 2){
-                int d = fgetc(fin);
-                if (d != EOF && is_big5_follow((unsigned char)d)){ 
-                    tmp[1] = (unsigned char)d;
-                    symbLen = 2;   
-                } else {
-                    if (d != EOF) ungetc(d, fin); 
-                }
+        free(ts);
+    }
+
+    // ------------------ order-1: context tables replace the codebook --------------------
+    if (ntab > 0) {
+        long long *hist;
+        StrBuf csv1 = {0};
+        nt = cluster_contexts(&pairs, used, ntab, ctx_tab, &hist);
+        // codebook: table count, start / context -> table (default 0), then every table
+        sb_printf(&csv1, "#tables,%d\n#start,%d\n", nt, ctx_tab[CTX_START]);
+        for (int c = 0; c < used; c++) {
+            if (symb[c].count == 0 || ctx_tab[c] == 0 || c == eofIdx || c == runIdx) continue;
+            sb_printf(&csv1, "#ctx,%d,", ctx_tab[c]);
+            csv_char(symb[c].chr, symb[c].useLen, &csv1);
+            sb_putc(&csv1, '\n');
+        }
+        for (int t = 0; t < nt; t++) {
+            tcode[t] = (char**)malloc(used * sizeof(char*));
+            tsymb[t] = build_table(symb, hist + (size_t)t * used, used, tcode[t]);
+            sb_printf(&csv1, "#table,%d\n", t);
+            for (int c = 0; c < used; c++) { // compact lines, decoder only needs symbol and code
+                if (tcode[t][c] == NULL) continue;
+                csv_char(symb[c].chr, symb[c].useLen, &csv1);
+                sb_printf(&csv1, ",,,%s,\n", tcode[t][c]);
             }
         }
+        unsigned long long bits1 = 0;
+        for (size_t i = 0; i < pairs.cap; i++) {
+            PairCnt *pc = &pairs.slot[i];
+            if (pc->n) bits1 += (unsigned long long)pc->n * strlen(tcode[ctx_tab[pc->key / CTX_SPAN]][pc->key % CTX_SPAN]);
+        }
+        // keep the single codebook when tables cost more than they save
+        if ((bits1 + 7) / 8 + csv1.len < (bits + 7) / 8 + csv->len) {
+            free(csv->s);
+            *csv = csv1;
+            bits = bits1;
+        } else {
+            free(csv1.s);
+            for (int t = 0; t < nt; t++) { free(tcode[t]); free(tsymb[t]); }
+            nt = 0;
+        }
+        free(hist);
+        free(pairs.slot);
+    }
+    if (runcsv.len > 0) sb_puts(csv, runcsv.s);
+    free(runcsv.s);
+    return bits + run_bits;
+}
 
-        // handle non ASCII, UTF-8, Big-5 symbols (128~255)
-        if (symbLen == 1){ 
-            // count++ -> write_code
-            write_code(symb[b0].code, strlen(symb[b0].code), fout); 
-            continue;
+// ================== append mode (-a) ==================
+// new data becomes a new frame at the end of an existing encoded stream,
+// without a codebook of its own when the last codebook can code it in fewer bytes
+static int file_le(FILE *fp, int nbytes, uint64_t *v){
+    unsigned char b[8];
+    if (fread(b, 1, nbytes, fp) != (size_t)nbytes) return 0;
+    *v = 0;
+    for (int i = nbytes - 1; i >= 0; i--) *v = (*v << 8) | b[i];
+    return 1;
+}
+
+// -------------- codebook of the last frame, skipping payloads --------------
+// *cb = NULL for an empty file, return 0 if not an encoded stream
+// -------------- payload length of a FRAME_STREAMED frame: decode up to its EOF code --------------
+// fp at the payload, cb = codebook text of the frame; return 0 if it can't be found
+static int streamed_len(FILE *fp, const char *cb, uint64_t cb_len, uint64_t *plen){
+    static unsigned char buf[IO_BLOCK], out[IO_BLOCK];
+    char *text = (char*)malloc(cb_len + 1); // cut into lines by parsing
+    if (text == NULL) return 0;
+    memcpy(text, cb, cb_len);
+    Codebook c;
+    cb_from_text(&c, text, cb_len);
+    free(text);
+    HsDec d;
+    off_t at = ftello(fp);
+    uint64_t used = 0;
+    int ok = hs_dec_init(&d, &c);
+    if (!ok) fprintf(stderr, "streamed frame without a plain codebook\n");
+    while (ok && !d.done) {
+        size_t n = fread(buf, 1, sizeof(buf), fp), w;
+        if (n == 0) { fprintf(stderr, "streamed frame ends before its EOF code\n"); ok = 0; break; }
+        for (size_t pos = 0; pos < n && !d.done; ) { // output is thrown away, only the end counts
+            long long k = hs_dec_feed(&d, buf + pos, n - pos, out, sizeof(out), &w);
+            if (k < 0) { ok = 0; break; }
+            pos += (size_t)k;
+            used += (uint64_t)k;
         }
+    }
+    cb_free(&c);
+    *plen = used;
+    return ok && fseeko(fp, at, SEEK_SET) == 0;
+}
 
-        // 3. write multibyte symbol code
-        for(int i=BYTE_MAX;i<used;i++){ 
-            if(symb[i].useLen==symbLen && memcmp(symb[i].chr,tmp,symbLen)==0){ 
-                // count++ -> write_code
-                write_code(symb[i].code, strlen(symb[i].code), fout); 
-                break; 
+static int last_codebook(FILE *fp, char **cb, uint64_t *cb_len, int *type){
+    unsigned char head[4];
+    size_t n;
+    *cb = NULL;
+    fseeko(fp, 0, SEEK_SET);
+    while ((n = fread(head, 1, 4, fp)) > 0) {
+        uint64_t len, plen;
+        if (n != 4 || head[0] != FRAME_MAGIC0 || head[1] != FRAME_MAGIC1 || !file_le(fp, 4, &len)) return 0;
+        if (!(head[3] & FRAME_SAME_CB) && head[2] != FRAME_INDEX && head[2] != FRAME_STORED) {
+            free(*cb);
+            *cb = (char*)malloc(len + 1);
+            if (*cb == NULL || fread(*cb, 1, len, fp) != len) return 0;
+            *cb_len = len;
+            *type = head[2];
+        }
+        if (!file_le(fp, 8, &plen)) return 0;
+        if (plen == FRAME_STREAMED && (*cb == NULL || !streamed_len(fp, *cb, *cb_len, &plen))) return 0; // encoder -u, huffd
+        if (head[3] & FRAME_CRC) plen += 4; // crc after payload
+        if (fseeko(fp, (off_t)plen, SEEK_CUR) != 0) return 0;
+    }
+    fseeko(fp, 0, SEEK_END); // switch to writing (appends)
+    return 1;
+}
+
+// -------------- code strings of a decode tree --------------
+static void tree_codes(const Codebook *cb, int idx, char *path, int depth, char **code){
+    if (idx == 0 || depth > 255) return;
+    const Node *node = &cb->nodes[idx];
+    if (node->is_leaf) {
+        int idx = symbol_index(symb, node->chr, node->useLen);
+        if (idx >= 0 && code[idx] == NULL) {
+            path[depth] = '\0';
+            code[idx] = strdup(path);
+        }
+        return;
+    }
+    path[depth] = '0';
+    tree_codes(cb, node->left, path, depth + 1, code);
+    path[depth] = '1';
+    tree_codes(cb, node->right, path, depth + 1, code);
+}
+
+// -------------- codes of a plain codebook text for every counted symbol --------------
+// code[] gets malloc'd strings, *pbits = payload bits with them; return 0 if a symbol has none
+static int codebook_codes(char *text, uint64_t len, char **code, unsigned long long *pbits){
+    Codebook cb;
+    cb_from_text(&cb, text, len);
+    memset(code, 0, MAX_SYMB * sizeof(char*));
+    char path[257];
+    if (cb.ntables == 1 && cb.lenroot == 0 && cb.ans_log == 0) tree_codes(&cb, cb.roots[0], path, 0, code);
+    cb_free(&cb);
+
+    int ok = code[eofIdx] != NULL;
+    unsigned long long bits = ok ? strlen(code[eofIdx]) : 0;
+    for (int i = 0; i < used && ok; i++) {
+        if (i == eofIdx || symb[i].count == 0) continue;
+        if (code[i] == NULL) ok = 0; // symbol not in that codebook
+        else bits += (unsigned long long)symb[i].count * strlen(code[i]);
+    }
+    *pbits = bits;
+    return ok;
+}
+// -------------- codes from codebook_codes() replace the own ones --------------
+static void use_codes(char **code, int ok){
+    for (int i = 0; i < used; i++) {
+        if (ok && code[i]) strcpy(symb[i].code, code[i]);
+        free(code[i]);
+    }
+}
+
+// -------------- use the old codebook if it has every symbol and is smaller --------------
+// *bits: payload bits of the new codebook, updated on reuse; return 1 = reuse
+static int reuse_codebook(char *text, uint64_t len, int type, size_t csv_len, unsigned long long *bits){
+    if (type != FRAME_HUFFMAN || nt > 0 || runIdx >= 0) return 0; // only plain single tables
+    static char *code[MAX_SYMB];
+    unsigned long long old_bits;
+    int ok = codebook_codes(text, len, code, &old_bits) && (old_bits + 7) / 8 < (*bits + 7) / 8 + csv_len;
+    use_codes(code, ok);
+    if (ok) *bits = old_bits;
+    return ok;
+}
+
+// ================== archive of many files (-A) ==================
+// one codebook from all members (or -u codebook_csv), members coded in memory on a
+// thread pool, written in order as frames, then the member index (see frame.h)
+#define MAX_WORKERS     64
+#define MEMBER_AHEAD    4         // members coded ahead of the writer, per worker
+#define MAX_NAME        65535     // index entry keeps name length in 16 bits
+
+typedef struct {
+    const char *name;
+    StrBuf data;       // payload
+    uint64_t size;     // original bytes
+    uint32_t crc;
+    int stored;        // 1 = data is the original bytes (coding didn't shrink them)
+    int nocode;        // symbols didn't fit the codebook when counting: stored
+    int state;         // 0 = not yet, 1 = done, -1 = can't read / changed since counting
+} Member;
+
+Member *members = NULL;
+int nmembers = 0;
+atomic_int nextMember;
+int memberWritten = 0;    // members the writer is done with (memberLock)
+int memberAhead = 0;      // workers start member i once i < memberWritten + memberAhead
+int memberStop = 0;       // writer gave up, take nothing more
+pthread_mutex_t memberLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t memberDone = PTHREAD_COND_INITIALIZER;
+pthread_cond_t memberWrote = PTHREAD_COND_INITIALIZER;
+
+// -------------- whole file + 4 zero bytes (symbol scan reads ahead) --------------
+static unsigned char* load_file(const char *fn, size_t *len){
+    FILE *fp = fopen(fn, "rb");
+    if (fp == NULL) return NULL;
+    size_t cap = 4096, n = 0, k;
+    unsigned char *s = (unsigned char*)malloc(cap + 4);
+    while (s && (k = fread(s + n, 1, cap - n, fp)) > 0) {
+        n += k;
+        if (n == cap) s = (unsigned char*)realloc(s, (cap *= 2) + 4);
+    }
+    int err = ferror(fp) ? (errno ? errno : EIO) : 0;
+    fclose(fp);
+    if (err) { free(s); errno = err; return NULL; } // caller reports it like a failed fopen
+    if (s) memset(s + n, 0, 4);
+    *len = n;
+    return s;
+}
+
+// -------------- counting pass of one member in memory --------------
+// return 0 if symbol types ran out (fullStored): the member is stored, its counts are
+// taken back so they don't bloat the codebook of the others
+static int count_buffer(const unsigned char *p, size_t n, int cs){
+    static long long before[MAX_SYMB];
+    int used0 = used;
+    long long total0 = total;
+    for (int k = 0; k < used; k++) before[k] = symb[k].count;
+    for (size_t i = 0; i < n; ) {
+        int len = scan_symbol(p + i, cs);
+        int idx = symbol_add(p + i, len, 1);
+        if (symbFull) break;
+        symb[idx].count++;
+        total++;
+        i += len;
+    }
+    if (!symbFull) return 1;
+    symbFull = 0;
+    while (used > used0) { // newest first: linear probing slots come back as they were
+        used--;
+        symbSlot[symbol_slot(symb, symb[used].chr, symb[used].useLen)] = 0;
+        memset(&symb[used], 0, sizeof(Symb));
+    }
+    for (int k = 0; k < used; k++) symb[k].count = before[k];
+    total = total0;
+    return 0;
+}
+
+// -------------- bits of a member into memory (thread-safe, tables read only) --------------
+static inline void mem_bits(uint64_t *acc, int *cnt, uint64_t v, int n, StrBuf *out){
+    *acc = (*acc << n) | v; // *cnt < 8 pending bits first
+    *cnt += n;
+    while (*cnt >= 8) {
+        *cnt -= 8;
+        sb_putc(out, (char)(*acc >> *cnt));
+    }
+}
+static inline void mem_code(uint64_t *acc, int *cnt, int idx, StrBuf *out){
+    if (symCode[idx].len <= PAIR_MAX_BITS) { mem_bits(acc, cnt, symCode[idx].bits, symCode[idx].len, out); return; }
+    for (const char *c = symb[idx].code; *c; c++) mem_bits(acc, cnt, (uint64_t)(*c - '0'), 1, out);
+}
+// return 0 if a symbol has no code (file changed since counting)
+static int encode_buffer(const unsigned char *p, size_t n, int cs, StrBuf *out){
+    uint64_t acc = 0;
+    int cnt = 0;
+    for (size_t i = 0; i < n; ) {
+        if (i + 1 < n && (p[i] | p[i + 1]) < 0x80) {
+            const PackedCode *pc = &pairCode[p[i] << 7 | p[i + 1]];
+            if (pc->len >= 0) {
+                mem_bits(&acc, &cnt, pc->bits, pc->len, out);
+                i += 2;
+                continue;
             }
         }
+        int len = scan_symbol(p + i, cs);
+        int idx = symbol_index(symb, p + i, len);
+        if (idx < 0 || symCode[idx].len < 0) return 0;
+        mem_code(&acc, &cnt, idx, out);
+        i += len;
     }
-    // ---------------- end of input file -----------------------
-    write_code(symb[used-1].code, strlen(symb[used-1].code), fout); // write EOF code
-    if (bitInBuff> 0) {
-        // add 0 to fill last byte
-        byteBuffer <<= (8 - bitInBuff);
-        fputc(byteBuffer, fout); // last byte
+    mem_code(&acc, &cnt, eofIdx, out);
+    if (cnt > 0) sb_putc(out, (char)(acc << (8 - cnt))); // 0 padded
+    return 1;
+}
+
+// -------------- worker: next member not taken yet --------------
+static void* member_worker(void *arg){
+    int cs = *(int*)arg;
+    int i;
+    while ((i = atomic_fetch_add(&nextMember, 1)) < nmembers) {
+        Member *m = &members[i];
+        // coded members wait in memory until written: stay close to the writer
+        pthread_mutex_lock(&memberLock);
+        while (i >= memberWritten + memberAhead && !memberStop) pthread_cond_wait(&memberWrote, &memberLock);
+        int stop = memberStop;
+        pthread_mutex_unlock(&memberLock);
+        if (stop) break;
+        size_t n;
+        unsigned char *p = load_file(m->name, &n);
+        int st = -1;
+        if (p && (m->nocode || encode_buffer(p, n, cs, &m->data))) {
+            m->size = n;
+            m->crc = crc32c(0, p, n);
+            if (m->nocode || m->data.len >= n) { // no gain: stored, the next coded member takes the codebook
+                m->data.len = 0;
+                sb_write(&m->data, p, n);
+                m->stored = 1;
+            }
+            st = 1;
+        }
+        free(p);
+        pthread_mutex_lock(&memberLock);
+        m->state = st;
+        pthread_cond_broadcast(&memberDone);
+        pthread_mutex_unlock(&memberLock);
     }
+    return NULL;
+}
+
+static void file_put_le(FILE *fp, uint64_t v, int nbytes){
+    for (int i = 0; i < nbytes; i++) { fputc((int)(v & 0xFF), fp); v >>= 8; }
+}
+static void frame_head(FILE *fp, int type, int flags, const char *cb, size_t cb_len, uint64_t payload_len){
+    fputc(FRAME_MAGIC0, fp);
+    fputc(FRAME_MAGIC1, fp);
+    fputc(type, fp);
+    fputc(flags, fp);
+    file_put_le(fp, cb_len, 4);
+    if (cb_len > 0) fwrite(cb, 1, cb_len, fp);
+    file_put_le(fp, payload_len, 8);
+}
+
+// -------------- member names from stdin, one per line --------------
+static char** read_names(int *n){
+    static char line[4096];
+    int cap = 1024;
+    char **names = (char**)malloc(cap * sizeof(char*));
+    *n = 0;
+    while (names && fgets(line, sizeof(line), stdin)) {
+        size_t len = strcspn(line, "\r\n");
+        if (len == 0) continue;
+        line[len] = '\0';
+        if (*n == cap) names = (char**)realloc(names, (cap *= 2) * sizeof(char*));
+        if (names) names[(*n)++] = strdup(line);
+    }
+    return names;
+}
+
+// -------------- build the archive, return exit code --------------
+static int make_archive(const char *arc_fn, const char *use_cb, char **names, int n, int threads, int checksum){
+    if (n == 1 && strcmp(names[0], "-") == 0) names = read_names(&n);
+    if (names == NULL || n == 0) { fprintf(stderr, "no members\n"); return 1; }
+    nmembers = n;
+    members = (Member*)calloc(n, sizeof(Member));
+    if (members == NULL) { fprintf(stderr, "out of memory\n"); return 1; }
+    for (int i = 0; i < n; i++) {
+        members[i].name = names[i];
+        if (strlen(names[i]) > MAX_NAME) { fprintf(stderr, "%.64s...: member name longer than %d bytes\n", names[i], MAX_NAME); return 1; }
+    }
+
+    // ---------------------- statistic symbol of all members --------------------
+    init_symbols();
+    int cs = charset == CS_AUTO ? CS_MIXED : charset; // only speed, same symbols
+    fullStored = 1; // binary members are stored, not the end of the run
+    for (int i = 0; i < n; i++) {
+        size_t len;
+        unsigned char *p = load_file(names[i], &len);
+        if (p == NULL) { perror(names[i]); return 1; }
+        members[i].nocode = !count_buffer(p, len, cs);
+        free(p);
+    }
+    fullStored = 0;
+
+    // ---------------------- shared codebook --------------------
+    StrBuf csv = {0};
+    unsigned long long bits = build_codebook(&csv);
+    if (use_cb) { // given codebook, must have every symbol
+        size_t len;
+        unsigned char *text = load_file(use_cb, &len);
+        if (text == NULL) { perror(use_cb); return 1; }
+        static char *code[MAX_SYMB];
+        free(csv.s);
+        csv.s = NULL;
+        csv.len = csv.cap = 0;
+        sb_write(&csv, text, len);
+        int ok = codebook_codes((char*)text, len, code, &bits);
+        use_codes(code, ok);
+        free(text);
+        if (!ok) { fprintf(stderr, "%s: not a plain codebook with every symbol of the members\n", use_cb); return 1; }
+    }
+    pack_codes();
+
+    FILE *fout = open_stream(arc_fn, "wb");
+    if (fout == NULL) { perror(arc_fn); return 1; }
+
+    // ------------------ members on worker threads, written in order -----------------------
+    if (threads > n) threads = n;
+    pthread_t tid[MAX_WORKERS];
+    atomic_store(&nextMember, 0);
+    memberWritten = 0;
+    memberAhead = threads * MEMBER_AHEAD;
+    memberStop = 0;
+    for (int t = 0; t < threads; t++) pthread_create(&tid[t], NULL, member_worker, &cs);
+    StrBuf index = {0};
+    uint64_t at = 0, in_bytes = 0;
+    int ret = 0, cb_out = 0;
+    uint32_t count = (uint32_t)n;
+    unsigned char le[8];
+    for (int k = 0; k < 4; k++) le[k] = (unsigned char)(count >> (8 * k));
+    sb_write(&index, le, 4);
+    for (int i = 0; i < n; i++) {
+        Member *m = &members[i];
+        pthread_mutex_lock(&memberLock);
+        while (m->state == 0) pthread_cond_wait(&memberDone, &memberLock);
+        pthread_mutex_unlock(&memberLock);
+        if (m->state < 0) { fprintf(stderr, "%s: can't read or changed while archiving\n", m->name); ret = 1; break; }
+        int carry = !m->stored && !cb_out; // first coded member carries the codebook
+        int flags = (!m->stored && !carry ? FRAME_SAME_CB : 0) | (checksum ? FRAME_CRC : 0);
+        frame_head(fout, m->stored ? FRAME_STORED : FRAME_HUFFMAN, flags, csv.s, carry ? csv.len : 0, m->data.len);
+        if (carry) cb_out = 1;
+        if (m->data.len > 0) fwrite(m->data.s, 1, m->data.len, fout);
+        if (checksum) file_put_le(fout, m->crc, 4);
+        if (ferror(fout)) { perror(arc_fn); ret = 1; break; }
+        // index entry
+        size_t nl = strlen(m->name);
+        le[0] = (unsigned char)nl;
+        le[1] = (unsigned char)(nl >> 8);
+        sb_write(&index, le, 2);
+        sb_write(&index, m->name, nl);
+        for (int k = 0; k < 8; k++) le[k] = (unsigned char)(at >> (8 * k));
+        sb_write(&index, le, 8);
+        for (int k = 0; k < 8; k++) le[k] = (unsigned char)(m->size >> (8 * k));
+        sb_write(&index, le, 8);
+        at += 16 + (carry ? csv.len : 0) + m->data.len + (checksum ? 4 : 0);
+        in_bytes += m->size;
+        free(m->data.s);
+        m->data.s = NULL;
+        pthread_mutex_lock(&memberLock);
+        memberWritten = i + 1;
+        pthread_cond_broadcast(&memberWrote);
+        pthread_mutex_unlock(&memberLock);
+    }
+    if (ret != 0) { // stop taking members
+        atomic_store(&nextMember, n);
+        pthread_mutex_lock(&memberLock);
+        memberStop = 1;
+        pthread_cond_broadcast(&memberWrote);
+        pthread_mutex_unlock(&memberLock);
+    }
+    for (int t = 0; t < threads; t++) pthread_join(tid[t], NULL);
+
+    if (ret == 0) { // index frame, ends with its own offset
+        for (int k = 0; k < 8; k++) le[k] = (unsigned char)(at >> (8 * k));
+        sb_write(&index, le, 8);
+        frame_head(fout, FRAME_INDEX, 0, NULL, 0, index.len);
+        fwrite(index.s, 1, index.len, fout);
+        at += 16 + index.len;
+    }
+    if (ret == 0 && ferror(fout)) { perror(arc_fn); ret = 1; }
+    if (fclose(fout) != 0 && ret == 0) { perror(arc_fn); ret = 1; }
+    if (ret == 0) { // only after everything reached the file
+        FILE *msg = strcmp(arc_fn, "-") == 0 ? stderr : stdout;
+        fprintf(msg, "Archive: %d members, %llu bytes -> %llu bytes (codebook %zu bytes)\n",
+                n, (unsigned long long)in_bytes, (unsigned long long)at, csv.len);
+    }
+    free(index.s);
+    free(csv.s);
+    for (int i = 0; i < n; i++) free(members[i].data.s);
+    free(members);
+    return ret;
+}
+
+// ================== histogram files (-H count, -M merge, -B build) ==================
+// symbol counts of one input, so shards are counted where they are and only the counts
+// travel: "HFH1", 4 bytes symbol types, then per symbol 1 byte length, the bytes and the
+// count (7 bits per byte, low first, high bit = more). symbols are sorted by bytes, so a
+// merge gives the same file in any order and grouping
+#define HIST_MAGIC      "HFH1"
+
+static int cmp_symbol_bytes(const void *a, const void *b){
+    const Symb *x = *(const Symb**)a;
+    const Symb *y = *(const Symb**)b;
+    int n = x->useLen < y->useLen ? x->useLen : y->useLen;
+    int c = memcmp(x->chr, y->chr, n);
+    return c != 0 ? c : x->useLen - y->useLen;
+}
+
+// -------------- counted symbols to a histogram file --------------
+static int write_hist(const char *fn){
+    static Symb *sorted[MAX_SYMB];
+    uint32_t n = 0;
+    for (int i = 0; i < used; i++) if (symb[i].count > 0) sorted[n++] = &symb[i];
+    qsort(sorted, n, sizeof(Symb*), cmp_symbol_bytes);
+    FILE *fp = open_stream(fn, "wb");
+    if (fp == NULL) { perror(fn); return 1; }
+    fwrite(HIST_MAGIC, 1, 4, fp);
+    file_put_le(fp, n, 4);
+    for (uint32_t i = 0; i < n; i++) {
+        fputc(sorted[i]->useLen, fp);
+        fwrite(sorted[i]->chr, 1, sorted[i]->useLen, fp);
+        unsigned long long v = (unsigned long long)sorted[i]->count;
+        while (v >= 0x80) { fputc((int)(v & 0x7F) | 0x80, fp); v >>= 7; }
+        fputc((int)v, fp);
+    }
+    if (fclose(fp) != 0) { perror(fn); return 1; }
+    return 0;
+}
+
+// -------------- add the counts of a histogram file --------------
+static int read_hist(const char *fn){
+    size_t len, at = 8;
+    unsigned char *p = load_file(fn, &len);
+    if (p == NULL) { perror(fn); return 1; }
+    int ok = len >= 8 && memcmp(p, HIST_MAGIC, 4) == 0;
+    uint32_t n = ok ? (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24 : 0;
+    for (uint32_t i = 0; ok && i < n; i++) {
+        int sl = at < len ? p[at++] : 0;
+        if (sl < 1 || sl > 4 || at + sl > len) { ok = 0; break; } // plain symbols only
+        const unsigned char *chr = p + at;
+        at += sl;
+        unsigned long long v = 0;
+        int shift = 0, more = 1;
+        while (more && at < len && shift < 64) {
+            v |= (unsigned long long)(p[at] & 0x7F) << shift;
+            more = p[at++] & 0x80;
+            shift += 7;
+        }
+        if (more || (long long)v < 0) { ok = 0; break; }
+        symb[symbol_add(chr, sl, 1)].count += (long long)v;
+        total += (long long)v;
+    }
+    free(p);
+    if (!ok || at != len) { fprintf(stderr, "%s: not a histogram file\n", fn); return 1; }
+    return 0;
+}
+
+// -------------- -H: count in_fn only --------------
+static int count_to_hist(const char *in_fn, const char *hist_fn, int pipelined){
+    FILE *fin = open_stream(in_fn, "rb");
+    if (fin == NULL) { perror(in_fn); return 1; }
+    InStream in;
+    in_open(&in, fin, pipelined);
+    init_symbols();
+    if (charset == CS_AUTO) charset = detect_charset(&in);
+    count_plain(&in);
+    int rerr = in.err;
+    in_close(&in);
     fclose(fin);
-    fclose(fout);
+    if (rerr) { errno = rerr; perror(in_fn); return 1; }
+    return write_hist(hist_fn);
+}
+// -------------- -M: sum of histogram files --------------
+static int merge_hist(const char *out_fn, char **names, int n){
+    init_symbols();
+    for (int i = 0; i < n; i++) if (read_hist(names[i])) return 1;
+    return write_hist(out_fn);
+}
+// -------------- -B: codebook csv from a histogram --------------
+static int hist_codebook(const char *hist_fn, const char *cb_fn){
+    init_symbols();
+    if (read_hist(hist_fn)) return 1;
+    StrBuf csv = {0};
+    build_codebook(&csv);
+    FILE *fp = open_stream(cb_fn, "w");
+    if (fp == NULL) { perror(cb_fn); return 1; }
+    fwrite(csv.s, 1, csv.len, fp);
+    free(csv.s);
+    if (fclose(fp) != 0) { perror(cb_fn); return 1; }
     return 0;
-}
\ No newline at end of file
+}
+
+// ================== coding as the input arrives (-u without -A) ==================
+// given codebook, every chunk read (whatever a pipe / socket has) is coded and written
+// at once: frame with the codebook, payload_len FRAME_STREAMED, crc after the EOF code
+static int stream_encode(const char *cb_fn, const char *in_fn, const char *enc_fn, int checksum){
+    size_t len;
+    unsigned char *text = load_file(cb_fn, &len);
+    if (text == NULL) { perror(cb_fn); return 1; }
+    FILE *fin = open_stream(in_fn, "rb");
+    if (fin == NULL) { perror(in_fn); return 1; }
+    FILE *fout = open_stream(enc_fn, "wb");
+    if (fout == NULL) { perror(enc_fn); return 1; }
+    frame_head(fout, FRAME_HUFFMAN, checksum ? FRAME_CRC : 0, (char*)text, len, FRAME_STREAMED);
+
+    Codebook cb;
+    HsEnc e;
+    cb_from_text(&cb, (char*)text, len); // after the header, cuts text into lines
+    free(text);
+    if (!hs_enc_init(&e, &cb)) { fprintf(stderr, "%s: not a plain codebook\n", cb_fn); return 1; }
+    unsigned char *buf = (unsigned char*)malloc(IO_BLOCK), *obuf = (unsigned char*)malloc(IO_BLOCK);
+    if (buf == NULL || obuf == NULL) { fprintf(stderr, "out of memory\n"); return 1; }
+    long long k, t = 0;
+    size_t w;
+    int r = 1;
+    while (t >= 0 && (k = hs_read(fin, buf, IO_BLOCK)) > 0) {
+        for (long long at = 0; at < k; at += t) {
+            if ((t = hs_enc_feed(&e, buf + at, (size_t)(k - at), obuf, IO_BLOCK, &w)) < 0) break;
+            fwrite(obuf, 1, w, fout);
+        }
+        fflush(fout); // this chunk's bits are out (but the last < 8)
+    }
+    if (t >= 0 && k < 0) { perror(in_fn); t = -1; } // read error, not the end of the input: no EOF code
+    while (t >= 0 && (r = hs_enc_finish(&e, obuf, IO_BLOCK, &w)) >= 0) {
+        fwrite(obuf, 1, w, fout);
+        if (r == 1) break;
+    }
+    if (t >= 0 && r == 1 && checksum) file_put_le(fout, e.crc, 4);
+    free(buf);
+    free(obuf);
+    hs_enc_free(&e);
+    cb_free(&cb);
+    fclose(fin);
+    if (ferror(fout) | fclose(fout)) { perror(enc_fn); return 1; }
+    return (t >= 0 && r == 1) ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    // options before file names
+    int pipelined = 0; // -p: reader / writer threads overlap i/o with coding
+    int append = 0;    // -a: add a frame to enc_fn
+    int checksum = 1;  // -n: no crc32c of the input (frame flag FRAME_CRC / "#crc32c" line)
+    const char *archive = NULL; // -A: archive of the files after the options
+    const char *use_cb = NULL;  // -u: codebook csv for the archive instead of a new one, or to code a stream with
+    char hist = 0;              // -H count only, -M merge, -B build codebook (histogram files)
+    int threads = 4;            // -j: archive worker threads
+#ifdef _SC_NPROCESSORS_ONLN
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > MAX_WORKERS) threads = MAX_WORKERS;
+#endif
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+        if (strcmp(argv[argi], "-p") == 0) pipelined = 1;
+        else if (strcmp(argv[argi], "-a") == 0) append = 1;
+        else if (strcmp(argv[argi], "-n") == 0) checksum = 0;
+        else if (strcmp(argv[argi], "-A") == 0 && argi + 1 < argc) archive = argv[++argi];
+        else if (strcmp(argv[argi], "-u") == 0 && argi + 1 < argc) use_cb = argv[++argi];
+        else if (strcmp(argv[argi], "-H") == 0 || strcmp(argv[argi], "-M") == 0 || strcmp(argv[argi], "-B") == 0) hist = argv[argi][1];
+        else if (strcmp(argv[argi], "-j") == 0 && argi + 1 < argc) {
+            threads = atoi(argv[++argi]);
+            if (threads < 1 || threads > MAX_WORKERS) { fprintf(stderr, "-j needs 1~%d threads\n", MAX_WORKERS); return 1; }
+        }
+        else if (strcmp(argv[argi], "-t") == 0 && argi + 1 < argc) {
+            const char *cs = argv[++argi];
+            if (strcmp(cs, "auto") == 0) charset = CS_AUTO;
+            else if (strcmp(cs, "mixed") == 0) charset = CS_MIXED;
+            else if (strcmp(cs, "ascii") == 0) charset = CS_ASCII;
+            else if (strcmp(cs, "utf8") == 0) charset = CS_UTF8;
+            else if (strcmp(cs, "big5") == 0) charset = CS_BIG5;
+            else { fprintf(stderr, "-t needs auto, mixed, ascii, utf8 or big5\n"); return 1; }
+        }
+        else if (strcmp(argv[argi], "-e") == 0 && argi + 1 < argc) {
+            const char *bk = argv[++argi];
+            if (strcmp(bk, "huff") == 0) backend = BK_HUFF;
+            else if (strcmp(bk, "ans") == 0) backend = BK_ANS;
+            else if (strcmp(bk, "auto") == 0) backend = BK_AUTO;
+            else { fprintf(stderr, "-e needs huff, ans or auto\n"); return 1; }
+        }
+        else if (strcmp(argv[argi], "-s") == 0 && argi + 1 < argc) {
+            sampleBytes = atoll(argv[++argi]) << 20;
+            if (sampleBytes <= 0) { fprintf(stderr, "-s needs a sample size in MiB\n"); return 1; }
+        }
+        else if (strcmp(argv[argi], "-c") == 0 && argi + 1 < argc) {
+            ntab = atoi(argv[++argi]);
+            if (ntab < 1 || ntab > MAX_TABLES) { fprintf(stderr, "-c needs 1~%d tables\n", MAX_TABLES); return 1; }
+        }
+        else if (strcmp(argv[argi], "-m") == 0 && argi + 1 < argc) {
+            nmerge = atoi(argv[++argi]);
+            if (nmerge < 1 || nmerge > MAX_MERGES) { fprintf(stderr, "-m needs 1~%d tokens\n", MAX_MERGES); return 1; }
+        }
+        else if (strcmp(argv[argi], "-r") == 0 && argi + 1 < argc) {
+            runMin = atoi(argv[++argi]);
+            if (runMin < 2) { fprintf(stderr, "-r needs a run length of 2 or more\n"); return 1; }
+        }
+        else { fprintf(stderr, "unknown option %s\n", argv[argi]); return 1; }
+        argi++;
+    }
+    // archive: files (or "-": names on stdin) into one stream with a shared codebook
+    if (archive) {
+        if (argc - argi < 1 || append || ntab > 0 || runMin > 0 || nmerge > 0 || sampleBytes > 0 || backend != BK_HUFF) {
+            fprintf(stderr, "usage: %s -A archive_fn [-u cb_fn] [-j threads] [-n] [-t charset] file... (or - for names on stdin)\n", argv[0]);
+            return 1;
+        }
+        return make_archive(archive, use_cb, argv + argi, argc - argi, threads, checksum);
+    }
+    // histogram files: counts of shards, merged, codebook of the sum
+    if (hist) {
+        int plain = !archive && !use_cb && !append && ntab == 0 && runMin == 0 && nmerge == 0 && sampleBytes == 0 && backend == BK_HUFF;
+        if (plain && hist == 'H' && argc - argi == 2) return count_to_hist(argv[argi], argv[argi+1], pipelined);
+        if (plain && hist == 'M' && argc - argi >= 2) return merge_hist(argv[argi], argv + argi + 1, argc - argi - 1);
+        if (plain && hist == 'B' && argc - argi == 2) return hist_codebook(argv[argi], argv[argi+1]);
+        fprintf(stderr, "usage: %s -H [-p] [-t charset] in_fn hist_fn     count only\n"
+                        "       %s -M hist_fn in_hist...                merge\n"
+                        "       %s -B hist_fn cb_fn                     codebook of a histogram\n", argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    // stream: coded chunk by chunk as it arrives, with a given codebook
+    if (use_cb && argc - argi == 2 && !append && ntab == 0 && runMin == 0 && nmerge == 0 && sampleBytes == 0 && backend == BK_HUFF) {
+        return stream_encode(use_cb, argv[argi], argv[argi+1], checksum);
+    }
+    // check argument count
+    // "-" as in_fn / enc_fn: stdin / stdout, "-" as cb_fn: codebook embedded in encoded stream
+    if (argc - argi != 3 || use_cb) {
+        fprintf(stderr, "usage: %s [-p] [-a] [-n] [-c tables] [-r min_run] [-m tokens] [-s sample_mb] [-t charset] [-e backend] in_fn cb_fn enc_fn\n"
+                        "       %s -A archive_fn [-u cb_fn] [-j threads] [-n] [-t charset] file...\n"
+                        "       %s -u cb_fn [-n] in_fn enc_fn\n", argv[0], argv[0], argv[0]);
+        return 1; 
+    }
+    const char *in_fn = argv[argi], *cb_fn = argv[argi+1], *enc_fn = argv[argi+2];
+    int embed_cb = strcmp(cb_fn, "-") == 0;
+    if (sampleBytes > 0 && (ntab > 0 || runMin > 0 || append)) {
+        fprintf(stderr, "-s can't be used with -c, -r or -a\n");
+        return 1;
+    }
+    if (backend == BK_ANS && (sampleBytes > 0 || ntab > 0 || runMin > 0 || append)) {
+        fprintf(stderr, "-e ans can't be used with -s, -c, -r or -a\n");
+        return 1;
+    }
+    if (append && (!embed_cb || strcmp(enc_fn, "-") == 0)) {
+        fprintf(stderr, "-a needs an embedded codebook (cb_fn -) and an enc_fn file\n");
+        return 1;
+    }
+    // open files
+    // Read Binary
+    FILE *fin = open_stream(in_fn, "rb"); 
+    if (fin == NULL) { perror(in_fn); return 1; }
+    // Write
+    FILE *fcsv = NULL;
+    if (!embed_cb) {
+        fcsv = fopen(cb_fn, "w"); 
+        if (fcsv == NULL) { perror(cb_fn); return 1; }
+    }
+    // Write Binary
+    FILE *fout = append ? fopen(enc_fn, "a+b") : open_stream(enc_fn, "wb"); 
+    if (fout == NULL) { perror(enc_fn); return 1; }
+    char *last_cb = NULL; // -a: codebook of the last frame
+    uint64_t last_len = 0;
+    int last_type = 0;
+    if (append && !last_codebook(fout, &last_cb, &last_len, &last_type)) {
+        fprintf(stderr, "%s: not an encoded stream with codebook\n", enc_fn);
+        return 1;
+    }
+
+    // -s: sample only inputs much larger than the sample, payload size is filled in after encoding
+    long long in_size = sampleBytes > 0 ? input_size(fin) : -1;
+    long long frame_at = embed_cb ? (long long)ftello(fout) : 0;
+    sampled = in_size > 2 * sampleBytes && (!embed_cb || frame_at >= 0);
+    if (sampleBytes > 0 && !sampled) fprintf(stderr, "-s needs a large seekable input (and enc_fn with cb_fn -), counting all of it\n");
+
+    // ---------------------- statistic symbol --------------------
+    InStream in;
+    init_symbols();
+    if (sampled) {
+        InStream smp; // without reader thread, it seeks
+        in_open(&smp, fin, 0);
+        if (charset == CS_AUTO) charset = detect_charset(&smp);
+        if (nmerge > 0) learn_tokens(&smp);
+        count_sample(&smp, in_size);
+        if (smp.err) { errno = smp.err; perror(in_fn); return 1; }
+        in_close(&smp);
+        rewind(fin);
+        in_open(&in, fin, pipelined);
+    } else {
+        in_open(&in, fin, pipelined);
+        in_keep(&in); // second pass works on pipes too
+        fullStored = embed_cb;
+        if (charset == CS_AUTO) charset = detect_charset(&in);
+        if (nmerge > 0) learn_tokens(&in);
+        count_input(&in);
+    }
+    if (in.err) { errno = in.err; perror(in_fn); return 1; } // counts of a cut input are no use
+
+    // ---------------------- codebook --------------------
+    StrBuf csv = {0}; // codebook text
+    unsigned long long bits = symbFull ? 0 : build_codebook(&csv);
+    int same_cb = last_cb && !symbFull && reuse_codebook(last_cb, last_len, last_type, csv.len, &bits);
+    free(last_cb);
+    // -e: tANS payload size is known after encoding, the frame header is filled in then
+    if (backend != BK_HUFF && nt == 0 && runIdx < 0 && !sampled && !append && !symbFull && total > 0) {
+        if (embed_cb && frame_at < 0) {
+            if (backend == BK_ANS) fprintf(stderr, "-e ans with cb_fn - needs a seekable enc_fn, using huffman codes\n");
+        } else {
+            StrBuf acsv = {0};
+            unsigned long long abits = build_ans(&acsv);
+            if (backend == BK_ANS || (abits + 7) / 8 + acsv.len < (bits + 7) / 8 + csv.len) {
+                free(csv.s);
+                csv = acsv;
+                bits = abits;
+                useAns = 1;
+            } else free(acsv.s);
+        }
+    }
+
+    // no gain (binary, already compressed, tiny input): stored frame, the bytes as they are
+    unsigned long long in_bytes = in.nread;
+    int stored = embed_cb && !sampled && (symbFull || (bits + 7) / 8 + (same_cb ? 0 : csv.len) >= in_bytes);
+
+    // ------------------ encode input file -----------------------
+    OutStream out;
+    out_open(&out, fout, pipelined);
+    if (stored) {
+        out_putc(&out, FRAME_MAGIC0);
+        out_putc(&out, FRAME_MAGIC1);
+        out_putc(&out, FRAME_STORED);
+        out_putc(&out, checksum ? FRAME_CRC : 0);
+        out_put_le(&out, 0, 4);
+        out_put_le(&out, in_bytes, 8);
+    } else if (same_cb) {
+        // frame header only, codes of the frame before
+        out_putc(&out, FRAME_MAGIC0);
+        out_putc(&out, FRAME_MAGIC1);
+        out_putc(&out, last_type);
+        out_putc(&out, FRAME_SAME_CB | (checksum ? FRAME_CRC : 0));
+        out_put_le(&out, 0, 4);
+        out_put_le(&out, (bits + 7) / 8, 8);
+    } else if (embed_cb) {
+        // frame header + codebook
+        out_putc(&out, FRAME_MAGIC0);
+        out_putc(&out, FRAME_MAGIC1);
+        out_putc(&out, useAns ? FRAME_ANS : nt > 0 ? FRAME_ORDER1 : FRAME_HUFFMAN);
+        out_putc(&out, checksum ? FRAME_CRC : 0); // flags
+        out_put_le(&out, csv.len, 4);
+        out_write(&out, csv.s, csv.len);
+        out_put_le(&out, (bits + 7) / 8, 8);
+    }
+    size_t cb_len = csv.len;
+    if (!sampled) in_rewind(&in); // reset file pointer to beginning
+    in_crc_start(&in); // the encoding pass reads every byte once
+    nq = 0;
+    unsigned long long pbits = stored ? copy_input(&in, &out, in_bytes) * 8 : useAns ? encode_ans(&in, &out) : encode_input(&in, &out);
+
+    if (checksum && embed_cb) out_put_le(&out, in.crc, 4); // after payload
+    int werr = 0;
+    if (in.err) { errno = in.err; perror(in_fn); werr = 1; }
+    if (!embed_cb) { // codebook file, crc known now
+        fwrite(csv.s, 1, csv.len, fcsv);
+        if (checksum) fprintf(fcsv, "#crc32c,%08x\n", in.crc);
+        if (ferror(fcsv) | fclose(fcsv)) { perror(cb_fn); werr = 1; }
+    }
+    free(csv.s);
+    in_close(&in);
+    out_close(&out); // out.err checked with fclose below
+    if ((sampled || useAns) && embed_cb && !stored) { // payload size in frame header
+        fseeko(fout, (off_t)(frame_at + 8 + cb_len), SEEK_SET);
+        for (int i = 0; i < 8; i++) fputc((int)((((pbits + 7) / 8)) >> (8 * i)) & 0xFF, fout);
+    }
+    if (sampled) report_sample(pbits);
+    fclose(fin);
+    if (fclose(fout) != 0 || out.err) { if (out.err) errno = out.err; perror(enc_fn); werr = 1; }
+    for (int t = 0; t < nt; t++) { free(tcode[t]); free(tsymb[t]); }
+    free(trie.slot);
+    free(trieTok);
+    free(ansEnc);
+    return werr;
+}
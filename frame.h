@@ -0,0 +1,51 @@
+// encoded stream format with embedded codebook (codebook argument "-")
+//
+//   frame := "HF" type flags cb_len cb payload_len payload [crc]
+//     type        1 byte, FRAME_HUFFMAN, FRAME_ORDER1, FRAME_ANS, FRAME_STORED or FRAME_INDEX
+//     flags       1 byte, FRAME_SAME_CB: no codebook (cb_len 0), use the one of the frame before,
+//                 FRAME_CRC: crc follows the payload
+//     cb_len      4 bytes little-endian, codebook size
+//     cb          codebook csv text (same lines as codebook.csv),
+//                 FRAME_ORDER1: "#tables,n" "#start,t" "#ctx,t,sym" lines, then
+//                 "#table,t" followed by that table's codebook lines,
+//                 with -r: "RUN" symbol, then "#runlen" and the run length bucket lines,
+//                 FRAME_ANS: "#ans,log" then "sym",count,prob,freq,info lines (freq sums to 1 << log)
+//     payload_len 8 bytes little-endian, payload size in bytes,
+//                 FRAME_STREAMED: size not known when written (encoder -u), payload ends with the EOF code
+//     payload     huffman bits ending with EOF code, 0 padded to byte
+//                 (RUN code: bucket code b, then b bits, repeat = 1 followed by those bits)
+//                 FRAME_ANS: blocks of 32 bits symbol count n, log bits state, bits of n symbols,
+//                 ending with n = 0, 0 padded to byte
+//                 FRAME_STORED: the original bytes (cb_len 0), written when coding would not
+//                 make them smaller; the codebook of the frames around it stays in use
+//     crc         4 bytes little-endian, crc32c of the frame's original bytes
+//
+// a separate codebook file (not "-") ends with a "#crc32c,xxxxxxxx" line (hex) instead
+//
+// a stream is one or more frames back to back (encoded files can be concatenated,
+// encoder -a appends a frame to an existing stream)
+//
+// archive (encoder -A): one frame per member, the first coded one with the shared codebook,
+// the others FRAME_SAME_CB, or FRAME_STORED if they don't shrink or have symbols the codebook
+// has no room for (binary), then a FRAME_INDEX frame (decoders skip it) whose payload is
+//     count       4 bytes, members
+//     member      2 bytes name length, name, 8 bytes frame offset, 8 bytes original size
+//     index_at    8 bytes, offset of the FRAME_INDEX frame (last 8 bytes of the archive)
+// all little-endian; decoding the whole archive gives the members one after another
+#ifndef FRAME_H
+#define FRAME_H
+
+#define FRAME_MAGIC0   'H'
+#define FRAME_MAGIC1   'F'
+#define FRAME_HUFFMAN  'C'   // codebook + huffman payload
+#define FRAME_ORDER1   'O'   // previous symbol selects one of several codebooks
+#define FRAME_ANS      'A'   // table-based ANS instead of huffman codes
+#define FRAME_INDEX    'I'   // archive member index, no codebook
+#define FRAME_STORED   'S'   // original bytes, no codebook
+
+#define FRAME_SAME_CB  0x01  // flags: codebook of the frame before
+#define FRAME_CRC      0x02  // flags: crc32c of the decoded bytes after the payload
+
+#define FRAME_STREAMED 0xFFFFFFFFFFFFFFFFull // payload_len of a frame coded as the input arrived
+
+#endif
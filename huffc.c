@@ -0,0 +1,117 @@
+// codec daemon client: same arguments as decoder (or encoder -u), coding is done by huffd
+// usage: huffc [-s socket] output_file codebook_csv encoded_bin
+//        huffc [-s socket] -u codebook_csv [-n] input_file encoded_bin
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "huffd.h"  // request / reply
+
+// ------------------ whole codebook file into memory --------------------
+static char* read_file(const char *fn, size_t *len){
+    FILE *fp = fopen(fn, "rb");
+    if (fp == NULL) return NULL;
+    size_t cap = 4096, n = 0, k;
+    char *s = (char*)malloc(cap);
+    while (s && (k = fread(s + n, 1, cap - n, fp)) > 0) {
+        n += k;
+        if (n == cap) s = (char*)realloc(s, cap *= 2);
+    }
+    fclose(fp);
+    *len = n;
+    return s;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    const char *enc_cb = NULL; // -u: encode with this codebook
+    int flags = 0;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+        if (strcmp(argv[argi], "-s") == 0 && argi + 1 < argc) path = argv[++argi];
+        else if (strcmp(argv[argi], "-u") == 0 && argi + 1 < argc) enc_cb = argv[++argi];
+        else if (strcmp(argv[argi], "-n") == 0) flags |= HUFFD_NO_CRC;
+        else { fprintf(stderr, "unknown option %s\n", argv[argi]); return -1; }
+        argi++;
+    }
+    // "-" as output_file / encoded_bin: stdout / stdin, "-" as codebook_csv: codebook embedded in encoded stream
+    if (argc - argi != (enc_cb ? 2 : 3)) {
+        fprintf(stderr, "Usage: %s [-s socket] output_file codebook_csv encoded_bin\n", argv[0]);
+        fprintf(stderr, "       %s [-s socket] -u codebook_csv [-n] input_file encoded_bin\n", argv[0]);
+        return -1;
+    }
+    path = huffd_path(path);
+    // encode: input_file -> encoded_bin, else encoded_bin -> output_file
+    const char *out_fn, *cb_fn, *in_fn;
+    if (enc_cb) { in_fn = argv[argi]; out_fn = argv[argi+1]; cb_fn = enc_cb; }
+    else { out_fn = argv[argi]; cb_fn = argv[argi+1]; in_fn = argv[argi+2]; }
+    if (enc_cb && strcmp(cb_fn, "-") == 0) { fprintf(stderr, "encoding needs a codebook file\n"); return -1; }
+    FILE *msg = strcmp(out_fn, "-") == 0 ? stderr : stdout; // keep stdout clean for data
+
+    int fds[2];
+    fds[0] = strcmp(in_fn, "-") == 0 ? 0 : open(in_fn, O_RDONLY);
+    fds[1] = strcmp(out_fn, "-") == 0 ? 1 : open(out_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    size_t cb_len = 0;
+    char *text = NULL;
+    if (strcmp(cb_fn, "-") != 0) text = read_file(cb_fn, &cb_len);
+    if (fds[0] < 0 || fds[1] < 0 || (text == NULL && strcmp(cb_fn, "-") != 0)) {
+        perror("File open error");
+        return -1;
+    }
+    if (cb_len > HUFFD_MAX_CB) { fprintf(stderr, "%s: codebook too long for the daemon\n", cb_fn); return -1; }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror(path);
+        return -1;
+    }
+
+    // header with both descriptors, then codebook text
+    DaemonReq req = { { HUFFD_MAGIC0, HUFFD_MAGIC1 }, enc_cb ? HUFFD_ENCODE : HUFFD_DECODE, (char)flags, (uint32_t)cb_len };
+    char ctl[CMSG_SPACE(2 * sizeof(int))];
+    memset(ctl, 0, sizeof(ctl));
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl;
+    mh.msg_controllen = sizeof(ctl);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, 2 * sizeof(int));
+    if (sendmsg(sock, &mh, 0) != (ssize_t)sizeof(req)) { perror("sendmsg"); return -1; }
+    for (size_t sent = 0; sent < cb_len; ) {
+        ssize_t k = write(sock, text + sent, cb_len - sent);
+        if (k <= 0) { perror("write"); return -1; }
+        sent += (size_t)k;
+    }
+    free(text);
+
+    DaemonRep rep;
+    size_t got = 0;
+    ssize_t k;
+    while (got < sizeof(rep) && (k = read(sock, (char*)&rep + got, sizeof(rep) - got)) > 0) got += (size_t)k;
+    close(sock);
+    if (got != sizeof(rep)) { fprintf(stderr, "Error: no reply from daemon.\n"); return 1; }
+    if (rep.status == 2) fprintf(stderr, "Error: daemon rejected the request.\n");
+    else if (rep.status == 3) fprintf(stderr, "Error: checksum mismatch, output is corrupt.\n");
+    else if (rep.status == 4) fprintf(stderr, "%s: not a plain codebook\n", cb_fn);
+    else if (rep.status != 0) fprintf(stderr, "Error: daemon failed to %s (status %d).\n", enc_cb ? "encode" : "decode", (int)rep.status);
+    if (rep.status != 0) return 1;
+
+    if (enc_cb) fprintf(msg, "Encoding finished. Input bytes: %lld (%lld us, %d/%d codebooks cached)\n",
+            (long long)rep.symbols, (long long)rep.usec, (int)rep.cache_hit, (int)rep.tables);
+    else fprintf(msg, "Decoding finished. Total symbols: %lld (%lld us, %d/%d codebooks cached)\n",
+            (long long)rep.symbols, (long long)rep.usec, (int)rep.cache_hit, (int)rep.tables);
+    return 0;
+}
@@ -0,0 +1,353 @@
+// codec daemon: keeps decode / encode tables of recent codebooks in memory and codes
+// for huffc clients over a unix domain socket (see huffd.h)
+// usage: huffd [-s socket] [-w workers]
+#define _FILE_OFFSET_BITS 64 // files over 2 GiB on 32-bit systems
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "decode.h" // codebook tables & huffman decoding
+#include "stream.h" // stream encoder of a plain codebook
+#include "huffd.h"  // request / reply
+
+#define CACHE_SLOTS  64   // codebooks kept in memory
+#define MAX_WORKERS  64
+
+// ------------------ codebook cache, key = codebook text --------------------
+typedef struct {
+    uint64_t hash;            // FNV-1a of text
+    char *text;
+    size_t len;
+    Codebook cb;
+    HsEnc *enc;               // encoder tables, built on the first encode request
+    int enc_state;            // 0 = not built, 1 = enc ready, -1 = not a plain codebook
+    int refs;                 // requests using it
+    int priv;                 // 1 = not in cache (cache full of busy entries), freed on release
+    unsigned long long tick;  // last use, oldest idle entry is replaced
+} CacheEnt;
+
+CacheEnt *cache[CACHE_SLOTS];
+unsigned long long cacheTick = 0;
+pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t text_hash(const char *s, size_t n){
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+    return h;
+}
+// caller holds cacheLock
+static CacheEnt* cache_find(uint64_t h, const char *text, size_t len){
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        CacheEnt *e = cache[i];
+        if (e && e->hash == h && e->len == len && memcmp(e->text, text, len) == 0) {
+            e->refs++;
+            e->tick = ++cacheTick;
+            return e;
+        }
+    }
+    return NULL;
+}
+static void ent_free(CacheEnt *e){
+    if (e->enc) { hs_enc_free(e->enc); free(e->enc); }
+    cb_free(&e->cb);
+    free(e->text);
+    free(e);
+}
+
+// ------------------ get tables of a codebook, built on a miss --------------------
+static CacheEnt* cache_get(const char *text, size_t len, int *hit){
+    uint64_t h = text_hash(text, len);
+    pthread_mutex_lock(&cacheLock);
+    CacheEnt *e = cache_find(h, text, len);
+    pthread_mutex_unlock(&cacheLock);
+    if (e) { (*hit)++; return e; }
+
+    // build without the lock, other workers keep decoding
+    e = (CacheEnt*)calloc(1, sizeof(CacheEnt));
+    char *tmp = (char*)malloc(len + 1); // cut into lines while parsing
+    if (e == NULL || tmp == NULL || (e->text = (char*)malloc(len + 1)) == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    memcpy(e->text, text, len);
+    memcpy(tmp, text, len);
+    cb_from_text(&e->cb, tmp, len);
+    free(tmp);
+    e->hash = h;
+    e->len = len;
+    e->refs = 1;
+
+    pthread_mutex_lock(&cacheLock);
+    CacheEnt *other = cache_find(h, text, len); // built by another worker meanwhile
+    if (other) {
+        pthread_mutex_unlock(&cacheLock);
+        ent_free(e);
+        return other;
+    }
+    int slot = -1;
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        if (cache[i] == NULL) { slot = i; break; }
+        if (cache[i]->refs == 0 && (slot < 0 || cache[i]->tick < cache[slot]->tick)) slot = i;
+    }
+    if (slot < 0) e->priv = 1;
+    else {
+        if (cache[slot]) ent_free(cache[slot]);
+        cache[slot] = e;
+        e->tick = ++cacheTick;
+    }
+    pthread_mutex_unlock(&cacheLock);
+    return e;
+}
+static void cache_release(CacheEnt *e){
+    pthread_mutex_lock(&cacheLock);
+    int drop = (--e->refs == 0 && e->priv);
+    pthread_mutex_unlock(&cacheLock);
+    if (drop) ent_free(e);
+}
+
+// ------------------ encoder tables of an entry, built once; NULL = not a plain codebook --------------------
+// requests copy the untouched HsEnc: tables shared read only, stream state their own
+static const HsEnc* cache_enc(CacheEnt *c){
+    pthread_mutex_lock(&cacheLock);
+    int state = c->enc_state;
+    pthread_mutex_unlock(&cacheLock);
+    if (state == 0) {
+        HsEnc *e = (HsEnc*)malloc(sizeof(HsEnc));
+        if (e == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+        int ok = hs_enc_init(e, &c->cb);
+        pthread_mutex_lock(&cacheLock);
+        if (c->enc_state == 0) { // first one to finish installs it
+            c->enc_state = ok ? 1 : -1;
+            if (ok) { c->enc = e; e = NULL; }
+        }
+        state = c->enc_state;
+        pthread_mutex_unlock(&cacheLock);
+        if (e) { hs_enc_free(e); free(e); }
+    }
+    return state > 0 ? c->enc : NULL;
+}
+
+// ------------------ receive request header and the two descriptors --------------------
+// descriptors that came with a rejected request are closed
+static int recv_request(int conn, DaemonReq *req, int fds[2]){
+    char ctl[CMSG_SPACE(8 * sizeof(int))]; // room for extra ones, to close them
+    struct iovec iov = { req, sizeof(*req) };
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl;
+    mh.msg_controllen = sizeof(ctl);
+    ssize_t n = recvmsg(conn, &mh, MSG_WAITALL);
+    int got = 0;
+    for (struct cmsghdr *c = n > 0 ? CMSG_FIRSTHDR(&mh) : NULL; c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t nfd = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < nfd; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (got < 2) fds[got] = fd;
+            else close(fd);
+            got++;
+        }
+    }
+    if (n != (ssize_t)sizeof(*req) || got != 2 || (mh.msg_flags & MSG_CTRUNC)) {
+        for (int i = 0; i < got && i < 2; i++) close(fds[i]);
+        fds[0] = fds[1] = -1;
+        return 0;
+    }
+    return 1;
+}
+static int read_full(int fd, void *p, size_t n){
+    size_t got = 0;
+    while (got < n) {
+        ssize_t k = read(fd, (char*)p + got, n - got);
+        if (k <= 0) return 0;
+        got += (size_t)k;
+    }
+    return 1;
+}
+
+// ------------------ decode fds[0] into fds[1] --------------------
+static void serve_decode(const char *text, size_t len, InStream *in, OutStream *out, DaemonRep *rep){
+    if (text) {
+        // codebook from client
+        CacheEnt *e = cache_get(text, len, &rep->cache_hit);
+        rep->tables = 1;
+        out_crc_start(out);
+        rep->symbols = decode_bits(&e->cb, in, out, (unsigned long long)-1);
+        if (rep->symbols < 0) rep->status = 1;
+        else if (!cb_crc_ok(&e->cb, out_crc_end(out))) rep->status = 3;
+        cache_release(e);
+        return;
+    }
+    // codebook in every frame
+    char *cb;
+    uint64_t cb_len, payload_len;
+    int r, flags, type;
+    CacheEnt *e = NULL;
+    while ((r = read_frame(in, &cb, &cb_len, &payload_len, &flags, &type)) > 0) {
+        if (type == FRAME_STORED) { // copied straight through, codebook stays
+            free(cb);
+            out_crc_start(out);
+            long long k = copy_stored(in, out, payload_len);
+            if (k < 0) { rep->status = 1; break; }
+            rep->symbols += k;
+            if (!frame_crc_ok(in, flags, out_crc_end(out))) { rep->status = 3; break; }
+            continue;
+        }
+        if (!(flags & FRAME_SAME_CB)) { // new codebook, else keep the one before
+            if (e) cache_release(e);
+            e = cache_get(cb, cb_len, &rep->cache_hit);
+            rep->tables++;
+        }
+        free(cb);
+        if (e == NULL) { rep->status = 1; break; }
+        out_crc_start(out);
+        long long k = decode_bits(&e->cb, in, out, payload_len);
+        if (k < 0) { rep->status = 1; break; }
+        rep->symbols += k;
+        if (!frame_crc_ok(in, flags, out_crc_end(out))) { rep->status = 3; break; }
+    }
+    if (e) cache_release(e);
+    if (r < 0) rep->status = 1;
+}
+
+// ------------------ encode fds[0] into fds[1]: frame with the codebook, as encoder -u --------------------
+static void serve_encode(const char *text, size_t len, int flags, InStream *in, OutStream *out, DaemonRep *rep){
+    CacheEnt *c = cache_get(text, len, &rep->cache_hit);
+    const HsEnc *tmpl = cache_enc(c);
+    rep->tables = 1;
+    if (tmpl == NULL) { rep->status = 4; cache_release(c); return; }
+    HsEnc e = *tmpl;
+    unsigned char *obuf = (unsigned char*)malloc(IO_BLOCK);
+    if (obuf == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    int crc = !(flags & HUFFD_NO_CRC);
+    out_putc(out, FRAME_MAGIC0);
+    out_putc(out, FRAME_MAGIC1);
+    out_putc(out, FRAME_HUFFMAN);
+    out_putc(out, crc ? FRAME_CRC : 0);
+    out_put_le(out, len, 4);
+    out_write(out, text, len);
+    out_put_le(out, FRAME_STREAMED, 8);
+    size_t w;
+    int r = 0;
+    while (in->pos < in->len || in_refill(in)) {
+        long long k = hs_enc_feed(&e, in->buf + in->pos, in->len - in->pos, obuf, IO_BLOCK, &w);
+        if (k < 0) { rep->status = 1; break; }
+        out_write(out, obuf, w);
+        in->pos += (size_t)k;
+        rep->symbols += k;
+    }
+    while (rep->status == 0 && (r = hs_enc_finish(&e, obuf, IO_BLOCK, &w)) >= 0) {
+        out_write(out, obuf, w);
+        if (r == 1) break;
+    }
+    if (r < 0) rep->status = 1;
+    if (rep->status == 0 && crc) out_put_le(out, e.crc, 4);
+    free(obuf);
+    cache_release(c);
+}
+
+// ------------------ reply and log line of a request --------------------
+static void reply(int conn, DaemonRep *rep, char op, const struct timespec *t0){
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    rep->usec = (t1.tv_sec - t0->tv_sec) * 1000000LL + (t1.tv_nsec - t0->tv_nsec) / 1000;
+    if (write(conn, rep, sizeof(*rep)) != (ssize_t)sizeof(*rep)) { /* client gone */ }
+    fprintf(stderr, "%s: status %d, %lld %s, %d/%d codebooks cached, %lld us\n",
+            op == HUFFD_ENCODE ? "encode" : op == HUFFD_DECODE ? "decode" : "request",
+            (int)rep->status, (long long)rep->symbols, op == HUFFD_ENCODE ? "bytes" : "symbols",
+            (int)rep->cache_hit, (int)rep->tables, (long long)rep->usec);
+}
+
+// ------------------ one request: code fds[0] into fds[1] --------------------
+static void serve(int conn){
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    DaemonReq req;
+    DaemonRep rep;
+    memset(&rep, 0, sizeof(rep));
+    int fds[2] = { -1, -1 };
+    rep.status = 2; // bad request until it is read
+    if (!recv_request(conn, &req, fds)) { reply(conn, &rep, 0, &t0); return; }
+    char op = req.op;
+    char *text = NULL;
+    if (req.magic[0] != HUFFD_MAGIC0 || req.magic[1] != HUFFD_MAGIC1 || (op != HUFFD_DECODE && op != HUFFD_ENCODE)
+        || req.cb_len > HUFFD_MAX_CB || (op == HUFFD_ENCODE && req.cb_len == 0)
+        || (req.cb_len > 0 && ((text = (char*)malloc(req.cb_len + 1)) == NULL || !read_full(conn, text, req.cb_len)))) {
+        free(text);
+        close(fds[0]);
+        close(fds[1]);
+        reply(conn, &rep, op, &t0);
+        return;
+    }
+    FILE *fin = fdopen(fds[0], "rb");
+    FILE *fout = fin ? fdopen(fds[1], "wb") : NULL;
+    if (fout == NULL) {
+        perror("fdopen");
+        if (fin) fclose(fin); else close(fds[0]);
+        close(fds[1]);
+        free(text);
+        reply(conn, &rep, op, &t0);
+        return;
+    }
+    rep.status = 0;
+    InStream in;
+    OutStream out;
+    in_open(&in, fin, 0);
+    out_open(&out, fout, 0);
+    if (op == HUFFD_ENCODE) serve_encode(text, req.cb_len, req.flags, &in, &out, &rep);
+    else serve_decode(text, req.cb_len, &in, &out, &rep);
+    free(text);
+    if (in.err && rep.status == 0) rep.status = 1; // client's input broke off
+    in_close(&in);
+    if (out_close(&out) != 0 && rep.status == 0) rep.status = 1; // client's output didn't take it
+    fclose(fin);
+    fclose(fout);
+    reply(conn, &rep, op, &t0);
+}
+
+// ------------------ worker: accept and serve --------------------
+static void* worker_main(void *arg){
+    int srv = *(int*)arg;
+    for (;;) {
+        int conn = accept(srv, NULL, NULL);
+        if (conn < 0) continue;
+        serve(conn);
+        close(conn);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    int workers = 4;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) path = argv[++i];
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) workers = atoi(argv[++i]);
+        else { fprintf(stderr, "usage: %s [-s socket] [-w workers]\n", argv[0]); return 1; }
+    }
+    if (workers < 1 || workers > MAX_WORKERS) { fprintf(stderr, "-w needs 1~%d workers\n", MAX_WORKERS); return 1; }
+    path = huffd_path(path);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { fprintf(stderr, "socket path too long\n"); return 1; }
+    strcpy(addr.sun_path, path);
+    int srv = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path); // stale socket of an earlier run
+    if (srv < 0 || bind(srv, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(srv, 64) != 0) {
+        perror(path);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // client gone: write fails instead of killing the daemon
+    fprintf(stderr, "huffd: listening on %s, %d workers\n", path, workers);
+
+    pthread_t tid[MAX_WORKERS];
+    for (int i = 1; i < workers; i++) pthread_create(&tid[i], NULL, worker_main, &srv);
+    worker_main(&srv);
+    return 0;
+}
@@ -0,0 +1,50 @@
+// codec daemon protocol (unix domain socket, client and daemon on the same host)
+//
+//   request := DaemonReq + 2 file descriptors (SCM_RIGHTS): input, output
+//              then cb_len bytes of codebook csv text (at most HUFFD_MAX_CB)
+//   reply   := DaemonRep, after the daemon has written and closed its copy of the output
+//              (also for a bad request, status 2)
+//
+//   HUFFD_DECODE: encoded input -> original bytes, cb_len 0: codebook embedded in stream
+//   HUFFD_ENCODE: original bytes -> frame with the given plain codebook, as encoder -u
+//                 writes it (payload_len FRAME_STREAMED, crc unless HUFFD_NO_CRC)
+//
+// the daemon reads and writes the passed descriptors itself, no data goes through the socket
+#ifndef HUFFD_H
+#define HUFFD_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define HUFFD_SOCKET  "/tmp/huffd.sock"  // default socket path, HUFFD_SOCKET in environment overrides
+#define HUFFD_MAGIC0  'H'
+#define HUFFD_MAGIC1  'D'
+#define HUFFD_DECODE  'D'
+#define HUFFD_ENCODE  'E'
+#define HUFFD_NO_CRC  0x01               // flags, encode: frame without crc
+#define HUFFD_MAX_CB  (16u << 20)        // longest codebook text of a request
+
+typedef struct {
+    char magic[2];
+    char op;          // HUFFD_DECODE or HUFFD_ENCODE
+    char flags;       // HUFFD_NO_CRC
+    uint32_t cb_len;  // codebook text bytes after this header
+} DaemonReq;
+
+typedef struct {
+    int32_t status;    // 0 = ok, 1 = coding error, 2 = bad request, 3 = checksum mismatch,
+                       // 4 = not a plain codebook (encode)
+    int32_t cache_hit; // codebooks found in cache / all codebooks of the request
+    int32_t tables;    // codebooks used (frames)
+    int32_t pad;
+    int64_t symbols;   // decoded symbols, encode: input bytes
+    int64_t usec;      // time spent in the daemon
+} DaemonRep;
+
+static inline const char* huffd_path(const char *opt){
+    if (opt) return opt;
+    const char *env = getenv("HUFFD_SOCKET");
+    return env ? env : HUFFD_SOCKET;
+}
+
+#endif
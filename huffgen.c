@@ -0,0 +1,419 @@
+// decoder generator: codebook csv -> C source of a decoder for that codebook only
+// usage: huffgen [-n name] codebook_csv output_c (and output_h next to it)
+//
+// the decode tables and symbol bytes are static const data, EOF / longest code are
+// constants: no codebook parsing or tree building at run time, no "EOF" compare per
+// leaf, several bits per table lookup. the output builds as a library (name_init,
+// name_decode) or, with -DNAME_MAIN, as a standalone decoder of payloads made with
+// this codebook (and of frames carrying it, -f)
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "decode.h" // codebook parsing
+
+#define ROOT_BITS    10   // first lookup
+#define SUB_BITS     8    // each further lookup
+#define GEN_MAX_LEN  56   // longest code (bits in the 64-bit reader after a refill)
+
+typedef struct {
+    int sym;          // symbol index, nsyms = no code here
+    int len;          // leaf: code length, sub table: bits before it
+    int sub;          // bits of the sub table, 0 = leaf
+    int next;         // sub table offset
+} Entry;
+
+Entry *tab = NULL;      // all tables, root first
+int ntab = 0, captab = 0;
+const Node *leaf[65536]; // symbol index -> leaf
+int nsyms = 0, eofSym = -1, escSym = -1, maxSymLen = 1;
+
+// ------------------ whole codebook file, one spare byte --------------------
+static char* read_file(const char *fn, size_t *len){
+    FILE *fp = fopen(fn, "rb");
+    if (fp == NULL) return NULL;
+    size_t cap = 4096, n = 0, k;
+    char *s = (char*)malloc(cap + 1);
+    while (s && (k = fread(s + n, 1, cap - n, fp)) > 0) {
+        n += k;
+        if (n == cap) s = (char*)realloc(s, (cap *= 2) + 1);
+    }
+    fclose(fp);
+    *len = n;
+    return s;
+}
+
+// ------------------ codebook key: text before the "#crc32c" line --------------------
+// a separate codebook file gets that line, the same codebook embedded in frames doesn't
+static size_t key_len(const char *s, size_t n){
+    for (size_t i = 0; i + 8 <= n; i++) {
+        if ((i == 0 || s[i-1] == '\n') && memcmp(s + i, "#crc32c,", 8) == 0) return i;
+    }
+    return n;
+}
+
+// ------------------ number leaves, longest code below idx --------------------
+static int walk(const Codebook *cb, int idx, int depth){
+    const Node *node = &cb->nodes[idx];
+    if (node->is_leaf) {
+        if (nsyms == 65535) { fprintf(stderr, "too many symbols\n"); exit(1); }
+        if (node->useLen == 3 && memcmp(node->chr, "EOF", 3) == 0) eofSym = nsyms;
+        else if (node->useLen == 3 && memcmp(node->chr, "ESC", 3) == 0) escSym = nsyms;
+        else if (node->useLen > maxSymLen) maxSymLen = node->useLen;
+        leaf[nsyms++] = node;
+        return depth;
+    }
+    int l = node->left ? walk(cb, node->left, depth + 1) : depth;
+    int r = node->right ? walk(cb, node->right, depth + 1) : depth;
+    return l > r ? l : r;
+}
+static int sym_of(const Node *n){
+    for (int i = 0; i < nsyms; i++) if (leaf[i] == n) return i;
+    return nsyms;
+}
+static int depth_below(const Codebook *cb, int idx){
+    const Node *node = &cb->nodes[idx];
+    if (node->is_leaf) return 0;
+    int l = node->left ? depth_below(cb, node->left) : 0;
+    int r = node->right ? depth_below(cb, node->right) : 0;
+    return 1 + (l > r ? l : r);
+}
+
+// ------------------ lookup table of bits bits for the subtree at idx (code prefix depth) --------------------
+// return table offset, entries that are still inner nodes get a table of their own
+static int build_table(const Codebook *cb, int idx, int depth, int bits){
+    int at = ntab, size = 1 << bits;
+    if (ntab + size > captab) {
+        while (ntab + size > captab) captab = captab ? 2 * captab : 4096;
+        tab = (Entry*)realloc(tab, captab * sizeof(Entry));
+        if (tab == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    }
+    ntab += size;
+    for (int v = 0; v < size; v++) {
+        Entry e = { nsyms, 0, 0, 0 }; // no code
+        int curr = idx, k = 0;
+        while (curr != 0 && !cb->nodes[curr].is_leaf && k < bits) {
+            curr = ((v >> (bits - 1 - k)) & 1) ? cb->nodes[curr].right : cb->nodes[curr].left;
+            k++;
+        }
+        if (curr != 0 && cb->nodes[curr].is_leaf) {
+            e.sym = sym_of(&cb->nodes[curr]);
+            e.len = depth + k;
+        } else if (curr != 0) { // deeper: next lookup
+            int sub = depth_below(cb, curr);
+            e.sym = 0;
+            e.len = depth + bits;
+            e.sub = sub < SUB_BITS ? sub : SUB_BITS;
+            e.next = build_table(cb, curr, depth + bits, e.sub);
+        }
+        tab[at + v] = e;
+    }
+    return at;
+}
+
+// ------------------ write template, @ = name, $ = NAME --------------------
+const char *lname, *uname;
+static void emit(FILE *fp, const char *t){
+    for (; *t; t++) {
+        if (*t == '@') fputs(lname, fp);
+        else if (*t == '$') fputs(uname, fp);
+        else fputc(*t, fp);
+    }
+}
+
+static const char *type_src =
+"typedef struct {\n"
+"    uint16_t sym;     // symbol, $_SYMS = no code\n"
+"    uint8_t len;      // leaf: code length, sub table: bits before it\n"
+"    uint8_t sub;      // bits of the sub table, 0 = leaf\n"
+"    uint32_t next;    // sub table offset\n"
+"} @_entry;\n"
+"\n"
+"typedef struct {\n"
+"    const unsigned char *in;\n"
+"    size_t n, pos;     // payload bytes, next byte to load\n"
+"    uint64_t acc;      // cnt bits from the top\n"
+"    int cnt;\n"
+"    int done, bad;     // EOF code seen / invalid code or data ends early\n"
+"    long long count;   // symbols decoded\n"
+"} @_state;\n"
+"\n"
+"// start decoding a payload in memory\n"
+"void @_init(@_state *s, const void *in, size_t n);\n"
+"// decode into out until the EOF code or out is full, return bytes written, -1 = bad data\n"
+"long long @_decode(@_state *s, unsigned char *out, size_t cap);\n"
+"// payload bytes up to the end of the EOF code (after done)\n"
+"size_t @_used(const @_state *s);\n";
+
+static const char *func_src =
+"\n"
+"// ------------------ start decoding a payload in memory ------------------\n"
+"void @_init(@_state *s, const void *in, size_t n){\n"
+"    memset(s, 0, sizeof(*s));\n"
+"    s->in = (const unsigned char*)in;\n"
+"    s->n = n;\n"
+"}\n"
+"size_t @_used(const @_state *s){ return s->pos - (size_t)(s->cnt / 8); }\n"
+"\n"
+"// ------------------ decode into out until the EOF code or out is full ------------------\n"
+"long long @_decode(@_state *s, unsigned char *out, size_t cap){\n"
+"    const unsigned char *in = s->in;\n"
+"    size_t w = 0, pos = s->pos, n = s->n;\n"
+"    uint64_t acc = s->acc;\n"
+"    int cnt = s->cnt;\n"
+"    while (!s->done && cap - w >= $_ROOM) {\n"
+"        while (cnt <= 56 && pos < n) { acc |= (uint64_t)in[pos++] << (56 - cnt); cnt += 8; }\n"
+"        const @_entry *e = &@_tab[acc >> (64 - $_ROOT_BITS)];\n"
+"        while (e->sub) e = &@_tab[e->next + ((acc << e->len) >> (64 - e->sub))];\n"
+"        if (e->sym >= $_SYMS || e->len > cnt) { s->bad = 1; break; }\n"
+"        acc <<= e->len;\n"
+"        cnt -= e->len;\n"
+"        if (e->sym == $_EOF) { s->done = 1; break; }\n"
+"#if $_ESC >= 0\n"
+"        if (e->sym == $_ESC) { // 4 bits length - 1, then raw bytes\n"
+"            if (cnt < 4) { s->bad = 1; break; }\n"
+"            int k = (int)(acc >> 60) + 1;\n"
+"            acc <<= 4;\n"
+"            cnt -= 4;\n"
+"            for (int i = 0; i < k; i++) {\n"
+"                while (cnt <= 56 && pos < n) { acc |= (uint64_t)in[pos++] << (56 - cnt); cnt += 8; }\n"
+"                if (cnt < 8) { s->bad = 1; break; }\n"
+"                out[w++] = (unsigned char)(acc >> 56);\n"
+"                acc <<= 8;\n"
+"                cnt -= 8;\n"
+"            }\n"
+"            if (s->bad) break;\n"
+"            s->count++;\n"
+"            continue;\n"
+"        }\n"
+"#endif\n"
+"        memcpy(out + w, @_chr[e->sym], $_STRIDE);\n"
+"        w += @_len[e->sym];\n"
+"        s->count++;\n"
+"    }\n"
+"    s->pos = pos;\n"
+"    s->acc = acc;\n"
+"    s->cnt = cnt;\n"
+"    return s->bad ? -1 : (long long)w;\n"
+"}\n";
+
+static const char *main_src =
+"\n"
+"#ifdef $_MAIN\n"
+"// ------------------ standalone decoder ------------------\n"
+"// @ output_file encoded_bin      payload coded with this codebook (decoder output_file codebook_csv encoded_bin)\n"
+"// @ -f output_file encoded_bin   frames carrying this codebook (decoder output_file - encoded_bin)\n"
+"#include <stdio.h>\n"
+"#include <stdlib.h>\n"
+"\n"
+"static uint32_t @_crc_tab[256];\n"
+"static uint32_t @_crc32c(uint32_t crc, const unsigned char *p, size_t n){\n"
+"    if (@_crc_tab[1] == 0) {\n"
+"        for (uint32_t i = 0; i < 256; i++) {\n"
+"            uint32_t c = i;\n"
+"            for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));\n"
+"            @_crc_tab[i] = c;\n"
+"        }\n"
+"    }\n"
+"    crc = ~crc;\n"
+"    while (n--) crc = (crc >> 8) ^ @_crc_tab[(crc ^ *p++) & 0xFF];\n"
+"    return ~crc;\n"
+"}\n"
+"static uint64_t @_le(const unsigned char *p, int nbytes){\n"
+"    uint64_t v = 0;\n"
+"    for (int i = nbytes - 1; i >= 0; i--) v = (v << 8) | p[i];\n"
+"    return v;\n"
+"}\n"
+"static uint64_t @_key(const unsigned char *p, size_t n){ // fnv-1a up to a \"#crc32c\" line\n"
+"    uint64_t h = 14695981039346656037ull;\n"
+"    for (size_t i = 0; i < n; i++) {\n"
+"        if ((i == 0 || p[i-1] == '\\n') && i + 8 <= n && memcmp(p + i, \"#crc32c,\", 8) == 0) break;\n"
+"        h = (h ^ p[i]) * 1099511628211ull;\n"
+"    }\n"
+"    return h;\n"
+"}\n"
+"\n"
+"// decode one payload to fp, return payload bytes used, -1 on error\n"
+"static long long @_payload(const unsigned char *in, size_t n, FILE *fp, unsigned char *buf, uint32_t *crc, long long *count){\n"
+"    @_state s;\n"
+"    long long w;\n"
+"    @_init(&s, in, n);\n"
+"    *crc = 0;\n"
+"    while ((w = @_decode(&s, buf, 1 << 20)) >= 0) {\n"
+"        fwrite(buf, 1, (size_t)w, fp);\n"
+"        *crc = @_crc32c(*crc, buf, (size_t)w);\n"
+"        if (s.done) break;\n"
+"        if (w == 0) { s.bad = 1; break; } // data ends before the EOF code\n"
+"    }\n"
+"    *count += s.count;\n"
+"    if (s.bad) { fprintf(stderr, \"Error: invalid code or data ends early.\\n\"); return -1; }\n"
+"    return (long long)@_used(&s);\n"
+"}\n"
+"\n"
+"int main(int argc, char *argv[]){\n"
+"    int frames = argc == 4 && strcmp(argv[1], \"-f\") == 0;\n"
+"    if (argc != 3 + frames) { fprintf(stderr, \"Usage: %s [-f] output_file encoded_bin\\n\", argv[0]); return -1; }\n"
+"    const char *out_fn = argv[1 + frames], *enc_fn = argv[2 + frames];\n"
+"    FILE *fin = strcmp(enc_fn, \"-\") == 0 ? stdin : fopen(enc_fn, \"rb\");\n"
+"    FILE *fout = strcmp(out_fn, \"-\") == 0 ? stdout : fopen(out_fn, \"wb\");\n"
+"    if (!fin || !fout) { perror(\"File open error\"); return -1; }\n"
+"    size_t cap = 1 << 20, n = 0, k;\n"
+"    unsigned char *in = (unsigned char*)malloc(cap), *buf = (unsigned char*)malloc(1 << 20);\n"
+"    while (in && (k = fread(in + n, 1, cap - n, fin)) > 0) {\n"
+"        n += k;\n"
+"        if (n == cap) in = (unsigned char*)realloc(in, cap *= 2);\n"
+"    }\n"
+"    if (in == NULL || buf == NULL) { fprintf(stderr, \"out of memory\\n\"); return -1; }\n"
+"    long long count = 0;\n"
+"    uint32_t crc;\n"
+"    int ret = 0;\n"
+"    if (!frames) {\n"
+"        if (@_payload(in, n, fout, buf, &crc, &count) < 0) ret = 1;\n"
+"        else if ($_HAS_CRC && crc != $_CRC) { fprintf(stderr, \"Error: checksum mismatch (%08x, expected %08x).\\n\", crc, (uint32_t)$_CRC); ret = 1; }\n"
+"    }\n"
+"    for (size_t at = 0, have_cb = 0; frames && at < n; ) { // frame by frame\n"
+"        const unsigned char *h = in + at;\n"
+"        uint64_t cb_len = n - at >= 8 ? @_le(h + 4, 4) : 0, len;\n"
+"        if (n - at < 16 || h[0] != 'H' || h[1] != 'F' || cb_len > n - at - 16) { fprintf(stderr, \"Error: not an encoded stream with codebook.\\n\"); ret = 1; break; }\n"
+"        len = @_le(h + 8 + cb_len, 8);\n"
+"        at += 16 + (size_t)cb_len;\n"
+"        if (h[2] == 'I') { at += (size_t)(len < n - at ? len : n - at); continue; } // archive index\n"
+"        size_t avail = (len != 0xFFFFFFFFFFFFFFFFull && len < n - at) ? (size_t)len : n - at;\n"
+"        if (h[2] == 'S') { // stored: the bytes as they are, codebook stays\n"
+"            fwrite(in + at, 1, avail, fout);\n"
+"            crc = @_crc32c(0, in + at, avail);\n"
+"            count += (long long)avail;\n"
+"            at += avail;\n"
+"        } else {\n"
+"            if (!(h[3] & 0x01)) have_cb = h[2] == 'C' && @_key(h + 8, (size_t)cb_len) == $_CB_KEY;\n"
+"            if (!have_cb) { fprintf(stderr, \"Error: frame with another codebook.\\n\"); ret = 1; break; }\n"
+"            long long used = @_payload(in + at, avail, fout, buf, &crc, &count);\n"
+"            if (used < 0) { ret = 1; break; }\n"
+"            at += len != 0xFFFFFFFFFFFFFFFFull ? avail : (size_t)used;\n"
+"        }\n"
+"        if (h[3] & 0x02) { // crc after the payload\n"
+"            if (n - at < 4 || (uint32_t)@_le(in + at, 4) != crc) { fprintf(stderr, \"Error: checksum mismatch.\\n\"); ret = 1; break; }\n"
+"            at += 4;\n"
+"        }\n"
+"    }\n"
+"    fprintf(fout == stdout ? stderr : stdout, \"Decoding finished. Total symbols: %lld\\n\", count);\n"
+"    free(in);\n"
+"    free(buf);\n"
+"    fclose(fin);\n"
+"    fclose(fout);\n"
+"    return ret;\n"
+"}\n"
+"#endif\n";
+
+int main(int argc, char *argv[]) {
+    const char *name = "hg";
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+        if (strcmp(argv[argi], "-n") == 0 && argi + 1 < argc) name = argv[++argi];
+        else { fprintf(stderr, "unknown option %s\n", argv[argi]); return -1; }
+        argi++;
+    }
+    if (argc - argi != 2) {
+        fprintf(stderr, "Usage: %s [-n name] codebook_csv output_c\n", argv[0]);
+        return -1;
+    }
+    for (const char *p = name; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_') { fprintf(stderr, "-n needs a C identifier\n"); return -1; }
+    }
+    const char *cb_fn = argv[argi], *out_fn = argv[argi+1];
+    size_t len;
+    char *text = read_file(cb_fn, &len);
+    if (text == NULL) { perror(cb_fn); return -1; }
+    uint64_t key = text_fnv(text, key_len(text, len));
+
+    Codebook cb;
+    cb_from_text(&cb, text, len);
+    if (cb.ntables != 1 || cb.lenroot != 0 || cb.ans_log != 0) {
+        fprintf(stderr, "%s: only plain codebooks (no -c, -r, -e ans)\n", cb_fn);
+        return 1;
+    }
+    int root = cb.roots[0];
+    int maxLen = walk(&cb, root, 0);
+    if (eofSym < 0) { fprintf(stderr, "%s: no EOF symbol\n", cb_fn); return 1; }
+    if (maxLen > GEN_MAX_LEN) { fprintf(stderr, "%s: codes over %d bits\n", cb_fn, GEN_MAX_LEN); return 1; }
+    int rootBits = maxLen < ROOT_BITS ? (maxLen > 0 ? maxLen : 1) : ROOT_BITS;
+    if (cb.nodes[root].is_leaf) { // only EOF, empty code
+        tab = (Entry*)malloc(2 * sizeof(Entry));
+        tab[0] = tab[1] = (Entry){ eofSym, 0, 0, 0 };
+        ntab = 2;
+    } else build_table(&cb, root, 0, rootBits);
+    int stride = 4;
+    while (stride < maxSymLen) stride *= 2;
+    int room = (escSym >= 0 && stride < 16) ? 16 : stride; // ESC: up to 16 raw bytes
+
+    char *up = strdup(name);
+    for (char *p = up; *p; p++) *p = (char)toupper((unsigned char)*p);
+    lname = name;
+    uname = up;
+    // name.h: constants, types, functions; name.c: tables and code
+    size_t on = strlen(out_fn);
+    char *h_fn = (char*)malloc(on + 3);
+    strcpy(h_fn, out_fn);
+    if (on > 2 && strcmp(out_fn + on - 2, ".c") == 0) h_fn[on - 1] = 'h';
+    else strcat(h_fn, ".h");
+    const char *h_base = strrchr(h_fn, '/') ? strrchr(h_fn, '/') + 1 : h_fn;
+    FILE *fp = fopen(h_fn, "w");
+    if (fp == NULL) { perror(h_fn); return 1; }
+    fprintf(fp, "// decoder of one codebook, generated by huffgen from %s, do not edit\n", cb_fn);
+    emit(fp, "//   @_init(&s, payload, n); then @_decode(&s, out, cap) until s.done (or -1 = bad data)\n"
+             "#ifndef $_DECODER_H\n"
+             "#define $_DECODER_H\n\n"
+             "#include <stdint.h>\n"
+             "#include <stddef.h>\n\n");
+    emit(fp, "#define $_SYMS       "); fprintf(fp, "%d\n", nsyms);
+    emit(fp, "#define $_EOF        "); fprintf(fp, "%d      // symbol index of EOF\n", eofSym);
+    emit(fp, "#define $_ESC        "); fprintf(fp, "%d      // symbol index of ESC, -1 = none\n", escSym);
+    emit(fp, "#define $_MAX_LEN    "); fprintf(fp, "%d      // longest code, bits\n", maxLen);
+    emit(fp, "#define $_ROOT_BITS  "); fprintf(fp, "%d      // bits of the first lookup\n", rootBits);
+    emit(fp, "#define $_STRIDE     "); fprintf(fp, "%d      // bytes copied per symbol\n", stride);
+    emit(fp, "#define $_ROOM       "); fprintf(fp, "%d      // output bytes of one symbol at most\n", room);
+    emit(fp, "#define $_CB_KEY     "); fprintf(fp, "0x%016llxull // fnv-1a of the codebook text before \"#crc32c\"\n", (unsigned long long)key);
+    emit(fp, "#define $_HAS_CRC    "); fprintf(fp, "%d\n", cb.has_crc);
+    emit(fp, "#define $_CRC        "); fprintf(fp, "0x%08xu // crc32c of the input the codebook file came with\n\n", cb.crc);
+    emit(fp, type_src);
+    emit(fp, "\n#endif\n");
+    if (fclose(fp) != 0) { perror(h_fn); return 1; }
+
+    fp = fopen(out_fn, "w");
+    if (fp == NULL) { perror(out_fn); return 1; }
+    fprintf(fp, "// decoder of one codebook, generated by huffgen from %s, do not edit\n", cb_fn);
+    emit(fp, "// library: cc -c, standalone decoder: cc -D$_MAIN\n");
+    fprintf(fp, "#include <string.h>\n#include \"%s\"\n", h_base);
+
+    // symbol bytes and lengths
+    emit(fp, "\nstatic const unsigned char @_chr[$_SYMS][$_STRIDE] = {\n");
+    for (int i = 0; i < nsyms; i++) {
+        fputs("    {", fp);
+        int n = (i == eofSym || i == escSym) ? 0 : leaf[i]->useLen;
+        for (int k = 0; k < stride; k++) fprintf(fp, "%s0x%02x", k ? "," : "", k < n ? leaf[i]->chr[k] : 0);
+        fputs("},\n", fp);
+    }
+    emit(fp, "};\nstatic const uint8_t @_len[$_SYMS] = {");
+    for (int i = 0; i < nsyms; i++) {
+        int n = (i == eofSym || i == escSym) ? 0 : leaf[i]->useLen;
+        fprintf(fp, "%s%d", i == 0 ? "\n    " : i % 32 ? "," : ",\n    ", n);
+    }
+    fputs("\n};\n", fp);
+    // lookup tables
+    emit(fp, "static const @_entry @_tab[] = {");
+    for (int i = 0; i < ntab; i++) {
+        fprintf(fp, "%s{%d,%d,%d,%d}", i == 0 ? "\n    " : i % 8 ? "," : ",\n    ", tab[i].sym, tab[i].len, tab[i].sub, tab[i].next);
+    }
+    fputs("\n};\n", fp);
+    emit(fp, func_src);
+    emit(fp, main_src);
+    fclose(fp);
+    printf("%s: %d symbols, longest code %d bits, %d table entries\n", out_fn, nsyms, maxLen, ntab);
+    free(up);
+    free(h_fn);
+    free(tab);
+    free(text);
+    cb_free(&cb);
+    return 0;
+}
@@ -1,26 +1,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
-#define MAX_SYMB 3000   
+#define MAX_SYMB  3000   
+#define MAX_WIDTH 16     // maximum fixed code width (bits)
+#define IO_BUF    65536  // input / output buffer size
 
-unsigned char byteBuffer = 0; // byte buffer for output (8 bits)
-int bitInBuff = 0; //number of bits in buffer
+int codeWidth = 0; // bits per code, length of code strings in codebook
 
 typedef struct {
     unsigned char chr[4]; // symbol (bytes)
     int useLen;           // symbol length (1~4)
 } DecodedSymb;
 
-DecodedSymb code_map[MAX_SYMB] = {0};
-// ----- string "0000101" to integer 5 -----
-static int str_to_int(const char *bin) {
+DecodedSymb code_map[1 << MAX_WIDTH] = {0}; // any code index of MAX_WIDTH bits
+// ----- string "0000101" to integer 5, *width = number of bits -----
+static int str_to_int(const char *bin, int *width) {
     int val = 0;
+    int i = 0;
     // reverse encoder int_to_bin
-    for (int i = 0; i < 7; i++) {
-        if (bin[i] == '\0') break; 
+    for (; i < MAX_WIDTH; i++) {
+        if (bin[i] != '0' && bin[i] != '1') break; // end of code ('\0' or newline)
         val = (val << 1) | (bin[i] - '0'); // '0'->0 , '1'->1
     }
+    *width = i;
     return val;
 }
 
@@ -66,28 +70,34 @@ static void parse_symbol(const char *line, DecodedSymb *sym) {
     sym->useLen = len;
 }
 
-// ----- read 7 bits from file and return index -----
-static int read_code(FILE *fin) {
-    int result = 0;
-    for (int i = 0; i < 7; i++) { // read 7 bits
-        // no bits in buffer
-        if (bitInBuff == 0) { 
-            int c = fgetc(fin); // get next 8-bit
-            if (c == EOF) {
-                return -1; // file end
-            }
-            byteBuffer = (unsigned char)c;
-            bitInBuff = 8;
-        }
-        // bitBuffer has bits
-        // construct result bit by bit
-        int bit = (byteBuffer & 0x80) >> 7; //get MSB(&10000000) and shift right 
-        result = (result << 1) | bit;// add bit to result
-        
-        byteBuffer = byteBuffer << 1; // shift left to discard MSB
-        bitInBuff--; // decrease bits in buffer
+// ----- unpack kernels: W bytes -> 8 codes of W bits (MSB first) -----
+// width is a compile-time constant so loops unroll to loads and shifts
+#define DEF_UNPACK8(W) \
+static void unpack8_w##W(const unsigned char *in, unsigned *c, int w) { \
+    (void)w; \
+    uint64_t v = 0; \
+    for (int i = 0; i < W; i++) v = (v << 8) | in[i]; /* 8*W <= 64 bits */ \
+    for (int i = 7; i >= 0; i--) { c[i] = (unsigned)(v & ((1u << W) - 1)); v >>= W; } \
+}
+DEF_UNPACK8(1) DEF_UNPACK8(2) DEF_UNPACK8(3) DEF_UNPACK8(4)
+DEF_UNPACK8(5) DEF_UNPACK8(6) DEF_UNPACK8(7) DEF_UNPACK8(8)
+
+// any width (9~16 bits): 64-bit accumulator
+static void unpack8_any(const unsigned char *in, unsigned *c, int w) {
+    uint64_t acc = 0;
+    int bits = 0, k = 0;
+    for (int i = 0; i < 8; i++) {
+        while (bits < w) { acc = (acc << 8) | in[k++]; bits += 8; }
+        bits -= w;
+        c[i] = (unsigned)((acc >> bits) & ((1u << w) - 1));
     }
-    return result;
+}
+
+typedef void (*UnpackFn)(const unsigned char *in, unsigned *c, int w);
+static UnpackFn unpack8_for(int w) {
+    static const UnpackFn tab[9] = { NULL, unpack8_w1, unpack8_w2, unpack8_w3, unpack8_w4,
+                                     unpack8_w5, unpack8_w6, unpack8_w7, unpack8_w8 };
+    return (w <= 8) ? tab[w] : unpack8_any;
 }
 
 int main(int argc, char *argv[]) {
@@ -116,7 +126,10 @@ int main(int argc, char *argv[]) {
         code_string++; // skip ","
         
         // change code ("0000101") to index (5) 
-        int code_index = str_to_int(code_string);
+        int width;
+        int code_index = str_to_int(code_string, &width);
+        if (width == 0) continue; // error format
+        codeWidth = width; // all codes have same width
 
         // if EOF symbol
         if (strncmp(line, "\"EOF\"", 5) == 0) {
@@ -136,23 +149,66 @@ int main(int argc, char *argv[]) {
     }
 
     // ------------------------- decode loop -------------------------
-    //run until read EOF code
-    while (1) {
-        int code_index = read_code(fin); // read 7 bits code index
+    // every 8 codes fill exactly codeWidth bytes: unpack whole groups, tail bit by bit
+    UnpackFn unpack8 = codeWidth > 0 ? unpack8_for(codeWidth) : NULL;
+    if (unpack8 == NULL) { // EOF line without a code
+        fprintf(stderr, "no code width in '%s' \n", argv[2]);
+        fclose(fin);
+        fclose(fout);
+        return 1;
+    }
+    static unsigned char inBuf[IO_BUF + MAX_WIDTH];
+    static unsigned char outBuf[IO_BUF + 8 * 4];
+    size_t inLen = 0, inPos = 0, outLen = 0;
+    int done = 0, fileEnd = 0;
+    unsigned codes[8];
 
-        // check unexpected EOF
-        if (code_index == -1) {
+    //run until read EOF code
+    while (!done) {
+        // keep at least one group in buffer
+        if (inLen - inPos < (size_t)codeWidth && !fileEnd) {
+            memmove(inBuf, inBuf + inPos, inLen - inPos);
+            inLen -= inPos;
+            inPos = 0;
+            size_t got = fread(inBuf + inLen, 1, IO_BUF, fin);
+            if (got == 0) fileEnd = 1;
+            inLen += got;
+            continue;
+        }
+        int n = 8; // codes in this group
+        if (inLen - inPos >= (size_t)codeWidth) {
+            unpack8(inBuf + inPos, codes, codeWidth);
+            inPos += codeWidth;
+        } else {
+            // last bytes of file: fewer than 8 codes
+            uint64_t acc = 0;
+            int bits = 0;
+            n = 0;
+            while (inPos < inLen) {
+                acc = (acc << 8) | inBuf[inPos++];
+                bits += 8;
+                while (bits >= codeWidth) { bits -= codeWidth; codes[n++] = (unsigned)((acc >> bits) & ((1u << codeWidth) - 1)); }
+            }
+            if (n == 0) { // check unexpected EOF
+                fprintf(stderr, "file error。\n");
+                break;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            // check EOF code
+            if ((int)codes[i] == eof_index) { done = 1; break; }
+            // mapping (e.g. "map[8] = A")
+            DecodedSymb *sym = &code_map[codes[i]]; // get symbol from table
+            memcpy(outBuf + outLen, sym->chr, 4); // write a symbol to output buffer
+            outLen += sym->useLen;
+        }
+        if (outLen >= IO_BUF) { fwrite(outBuf, 1, outLen, fout); outLen = 0; }
+        if (!done && fileEnd && inPos == inLen) { // check unexpected EOF
             fprintf(stderr, "file error。\n");
             break;
         }
-        // check EOF code
-        if (code_index == eof_index) {
-            break; 
-        }
-        // mapping (e.g. "map[8] = A")
-        DecodedSymb sym = code_map[code_index]; // get symbol from table
-        fwrite(sym.chr, 1, sym.useLen, fout); // write a symbol to output 
     }
+    fwrite(outBuf, 1, outLen, fout);
 
     fclose(fin);
     fclose(fout); 
@@ -2,20 +2,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #define BYTE_MAX     256  //maximum one byte number
-#define MAX_SYMB     3000  //maximux symbol type
+#define MAX_WIDTH    16    //maximum fixed code width (bits)
+#define MAX_SYMB     ((1 << MAX_WIDTH) - 1)  //maximux symbol type (+ EOF fits 16-bit codes)
+#define OUT_BUF      65536 //output buffer size
+#define SYMB_SLOTS   (1 << 17) //hash slots for multibyte symbols (more than MAX_SYMB)
 
 typedef struct {
     unsigned char chr[4];     //bytes of symbol
     int useLen;               //size: 1~4 bytes
     int count;                //number of this symbol
     double prob;              //probability 
-    char code[8];             //fixed encode
+    char code[MAX_WIDTH+1];   //fixed encode
+    unsigned val;             //fixed encode as integer
 } Symb;
 
-unsigned char byteBuffer = 0; // byte buffer for output (8 bits)
-int bitInBuff = 0; //number of bits in buffer
+int codeWidth = 7;            //bits per code, ceil(log2(symbols+1))
+unsigned group[8];            //codes waiting to be packed
+int inGroup = 0;              //number of codes in group
+unsigned char outBuf[OUT_BUF];//packed bytes waiting to be written
+int outLen = 0;
 
 //------------------ utf-8 decoding ------------------ 
 static int utf8_len(unsigned char b0){  //use first byte to check UTF-8 using length
@@ -40,6 +48,20 @@ static int is_big5_follow(unsigned char b1){
     return ( (b1 >= 0x40 && b1 <= 0x7E) || (b1 >= 0xA1 && b1 <= 0xFE) ); //check is big-5 rule
 }
 
+// -------------- hash slot of a multibyte symbol (index + 1, 0 = empty) --------------
+static int symbSlot[SYMB_SLOTS];
+static int symbol_slot(const Symb *symb, const unsigned char *tmp, int symbLen){
+    unsigned h = 2166136261u; // FNV-1a
+    for (int i = 0; i < symbLen; i++) h = (h ^ tmp[i]) * 16777619u;
+    h &= SYMB_SLOTS - 1;
+    while (symbSlot[h] != 0) {
+        const Symb *s = &symb[symbSlot[h] - 1];
+        if (s->useLen == symbLen && memcmp(s->chr, tmp, symbLen) == 0) break;
+        h = (h + 1) & (SYMB_SLOTS - 1);
+    }
+    return h;
+}
+
 // -------------- qsort compare function for codebook --------------
 static int cmp_codebook(const void *a, const void *b){
     const Symb *x = *(const Symb**)a; 
@@ -53,16 +75,54 @@ static int cmp_codebook(const void *a, const void *b){
     return memcmp(x->chr, y->chr, x->useLen); // Tertiary key: byte index (ascending)
 }
 
-// -------------- convert integer to 7-bit binary string --------------
-static void int_to_bin(int val, char *out_str) {
+// -------------- convert integer to width-bit binary string --------------
+static void int_to_bin(int val, int width, char *out_str) {
     // val is n'th code
-    out_str[7] = '\0'; //character ending
-    for (int i = 6; i >= 0; i--) {
+    out_str[width] = '\0'; //character ending
+    for (int i = width-1; i >= 0; i--) {
         out_str[i] = (val & 1) ? '1' : '0'; // val LSB to '1' or '0' from right to left
         val >>= 1; // shift val right 
     }
 }
 
+// -------------- code width for n symbols + EOF --------------
+static int code_width(int n) {
+    int w = 1;
+    while (w < MAX_WIDTH && (1 << w) < n + 1) w++; // ceil(log2(n+1)), at least 1 bit
+    return w;
+}
+
+// -------------- pack kernels: 8 codes of W bits -> W bytes (MSB first) --------------
+// width is a compile-time constant so loops unroll to shifts and stores
+#define DEF_PACK8(W) \
+static void pack8_w##W(const unsigned *c, unsigned char *out, int w) { \
+    (void)w; \
+    uint64_t v = 0; \
+    for (int i = 0; i < 8; i++) v = (v << W) | c[i]; /* 8*W <= 64 bits */ \
+    for (int i = W-1; i >= 0; i--) { out[i] = (unsigned char)v; v >>= 8; } \
+}
+DEF_PACK8(1) DEF_PACK8(2) DEF_PACK8(3) DEF_PACK8(4)
+DEF_PACK8(5) DEF_PACK8(6) DEF_PACK8(7) DEF_PACK8(8)
+
+// any width (9~16 bits): 64-bit accumulator, emit whole bytes
+static void pack8_any(const unsigned *c, unsigned char *out, int w) {
+    uint64_t acc = 0;
+    int bits = 0, k = 0;
+    for (int i = 0; i < 8; i++) {
+        acc = (acc << w) | c[i];
+        bits += w;
+        while (bits >= 8) { bits -= 8; out[k++] = (unsigned char)(acc >> bits); }
+    }
+}
+
+typedef void (*PackFn)(const unsigned *c, unsigned char *out, int w);
+static PackFn pack8_for(int w) {
+    static const PackFn tab[9] = { NULL, pack8_w1, pack8_w2, pack8_w3, pack8_w4,
+                                   pack8_w5, pack8_w6, pack8_w7, pack8_w8 };
+    return (w <= 8) ? tab[w] : pack8_any;
+}
+PackFn pack8 = pack8_w7; // kernel for codeWidth
+
 // -------------- write char to codebook csv file --------------
 static void csv_char(const unsigned char *s, int len, FILE *fp){   
     if (len==1 && s[0]=='\r'){ fputs("\"\\r\"",fp); return; }
@@ -76,21 +136,31 @@ static void csv_char(const unsigned char *s, int len, FILE *fp){
     fputc('"',fp);
 }
 // -------------- write code to output file --------------
-static void write_code(const char *code, int len, FILE *fp){
-    for (int k = 0; k < len; k++) {
-        // char '0'(48) or '1'(49) to bit 0 or 1
-        byteBuffer = (byteBuffer << 1) | (code[k] - '0'); // add 0 or 1 to buffer and shift left
-        bitInBuff++;
-
-        // when buffer is full (8 bits), write to file
-        if (bitInBuff == 8) {
-            //fprintf(stderr, "DEBUG [Data]: 0x%02X\n", g_bitBuffer); // print debug info
-            fputc(byteBuffer, fp);
-            bitInBuff = 0;
-            byteBuffer = 0;
-        }
-    }
+static void write_code(unsigned val, FILE *fp){
+    group[inGroup++] = val;
+    if (inGroup < 8) return;
+    // 8 codes -> codeWidth bytes
+    if (outLen + MAX_WIDTH > OUT_BUF) { fwrite(outBuf, 1, outLen, fp); outLen = 0; }
+    pack8(group, outBuf + outLen, codeWidth);
+    outLen += codeWidth;
+    inGroup = 0;
 } 
+// -------------- pack last codes, pad 0 to fill last byte & write --------------
+static void flush_codes(FILE *fp){
+    uint64_t acc = 0;
+    int bits = 0;
+    // tail needs up to codeWidth bytes, write_code only left MAX_WIDTH - codeWidth
+    if (outLen + codeWidth > OUT_BUF) { fwrite(outBuf, 1, outLen, fp); outLen = 0; }
+    for (int i = 0; i < inGroup; i++) {
+        acc = (acc << codeWidth) | group[i];
+        bits += codeWidth;
+        while (bits >= 8) { bits -= 8; outBuf[outLen++] = (unsigned char)(acc >> bits); }
+    }
+    if (bits > 0) outBuf[outLen++] = (unsigned char)(acc << (8 - bits)); // add 0 to fill last byte
+    inGroup = 0;
+    fwrite(outBuf, 1, outLen, fp);
+    outLen = 0;
+}
 
 int main(int argc, char *argv[]) {
     // check argument count
@@ -110,7 +180,7 @@ int main(int argc, char *argv[]) {
     if (fout == NULL) { perror(argv[3]); return 1; }
 
     // === symbol statics ===
-    Symb symb[MAX_SYMB]={0};
+    static Symb symb[MAX_SYMB]; // too big for the stack, starts zeroed
     
     // initial ascii symbols
     for(int i=0;i<=0x7F;i++){ 
@@ -183,24 +253,19 @@ int main(int argc, char *argv[]) {
         }
 
         // save multibyte symbol (utf-8 / big5)
-        int found=0;
-        for(int i=BYTE_MAX;i<used;i++){ 
+        int h = symbol_slot(symb, tmp, symbLen);
+        if(symbSlot[h] != 0){ 
             // find existing symbol
-            if(symb[i].useLen==symbLen && memcmp(symb[i].chr,tmp,symbLen)==0){ 
-                symb[i].count++; // count this symbol
-                found=1; // mark found
-                total++;
-                break; 
-            }
-        }
-
-        // not found, add new symbol
-        if(!found){ 
+            symb[symbSlot[h]-1].count++; // count this symbol
+            total++;
+        } else {
+            // not found, add new symbol
             // check symbol limit
             if(used >= MAX_SYMB) { fprintf(stderr, "symbols are too many (%d)!\n", used); return 1; }
             memcpy(symb[used].chr, tmp, symbLen); // copy symbol bytes
             symb[used].useLen = symbLen; // set symbol length
             symb[used].count = 1; // initialize count
+            symbSlot[h] = used + 1;
             total++; 
             used++; // push back used symbol types
         }
@@ -208,7 +273,7 @@ int main(int argc, char *argv[]) {
 
     // ------------------ generate codebook -----------------------
     // calculate probability & write to codebook file
-    Symb* out[MAX_SYMB]; // pointer array for qsort
+    static Symb* out[MAX_SYMB]; // pointer array for qsort
     int n=0; // number of used symbols
     for(int i=0;i<used;i++) {
         if(symb[i].count > 0){ // skip unused symbols
@@ -225,17 +290,22 @@ int main(int argc, char *argv[]) {
     // sort by count descending
     qsort(out, n, sizeof(Symb*), cmp_codebook); // sort function
 
-    // generate 7-bit(127) code and write to codebook.csv
-    char EOF_symb[8]; // for EOF symbol 
+    // generate fixed width code and write to codebook.csv
+    // width = ceil(log2(n+1)) (n symbols + EOF), the code strings in codebook keep the width
+    codeWidth = code_width(n);
+    if ((1 << codeWidth) < n + 1) { fprintf(stderr, "symbols are too many for %d-bit codes (%d)!\n", MAX_WIDTH, n); return 1; }
+    pack8 = pack8_for(codeWidth);
+    char EOF_symb[MAX_WIDTH+1]; // for EOF symbol 
     for(int i=0; i<n; i++){
-        // first symbol is 0000000 0000001 ...
-        int_to_bin(i, out[i]->code); // save 7-bit code
+        // first symbol is 000 001 ...
+        out[i]->val = i;
+        int_to_bin(i, codeWidth, out[i]->code); // save code string
         // write to codebook 
         csv_char(out[i]->chr, out[i]->useLen, fcsv); // write symbol 
         fprintf(fcsv, ",%d,%.7f,%s\n", out[i]->count, out[i]->prob, out[i]->code); //write count, prob, code
     }
     // add EOF symbol at the end
-    int_to_bin(n, EOF_symb); // EOF is n+1'th code
+    int_to_bin(n, codeWidth, EOF_symb); // EOF is n+1'th code
     fprintf(fcsv, "\"EOF\",0,0.0000000,%s\n", EOF_symb); // write EOF to codebook
     fclose(fcsv); // cb.csv
 
@@ -246,7 +316,7 @@ int main(int argc, char *argv[]) {
         // 1. handle ascii 0~127
         if(b0 <= 0x7F){ 
             // count++ -> write_code
-            write_code(symb[b0].code, 7, fout); 
+            write_code(symb[b0].val, fout); 
             continue; 
         }
 
@@ -289,26 +359,18 @@ int main(int argc, char *argv[]) {
         // handle non ASCII, UTF-8, Big-5 symbols (128~255)
         if (symbLen == 1){ 
             // count++ -> write_code
-            write_code(symb[b0].code, 7, fout); 
+            write_code(symb[b0].val, fout); 
             continue;
         }
 
         // 3. write multibyte symbol code
-        for(int i=BYTE_MAX;i<used;i++){ 
-            if(symb[i].useLen==symbLen && memcmp(symb[i].chr,tmp,symbLen)==0){ 
-                // count++ -> write_code
-                write_code(symb[i].code, 7, fout); 
-                break; 
-            }
-        }
+        int h = symbol_slot(symb, tmp, symbLen);
+        if(symbSlot[h] != 0) write_code(symb[symbSlot[h]-1].val, fout); 
+
     }
     // ---------------- end of input file -----------------------
-    write_code(EOF_symb, 7, fout);
-    if (bitInBuff> 0) {
-        // add 0 to fill last byte
-        byteBuffer <<= (8 - bitInBuff);
-        fputc(byteBuffer, fout); // last byte
-    }
+    write_code(n, fout); // EOF code
+    flush_codes(fout);
     fclose(fin);
     fclose(fout);
     return 0;
@@ -0,0 +1,294 @@
+// push-style streaming codec: input arrives in chunks of any size (sockets, pipes),
+// output goes straight into the caller's buffers. plain codebooks only (one table,
+// no RUN / tANS), symbols missing from the codebook need its "ESC" symbol
+//
+//   encode: hs_enc_init(&e, &cb)
+//           k = hs_enc_feed(&e, chunk, n, out, cap, &w)   k input bytes taken, w bytes written
+//           hs_enc_flush(): also code a symbol cut by the chunk end (as if input ended)
+//           hs_enc_finish(): the same, then the EOF code and the last byte
+//   decode: hs_dec_init(&d, &cb)
+//           k = hs_dec_feed(&d, chunk, n, out, cap, &w)   d.done after the EOF code
+//           stops early when out is full (any cap > 0), call again with the rest
+//
+// a symbol cut between two chunks (at most 3 bytes) or by a full out, and the bits of an
+// unfinished byte stay in the context, so memory per stream is fixed and output follows
+// every chunk
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "decode.h"   // codebook tables
+#include "charset.h"  // symbol boundaries, same as the encoder's
+#include <errno.h>
+
+#define HS_MAX_CODE  64          // longest code the stream encoder takes
+#define HS_ROOM      16          // output bytes of one symbol at most (ESC + 4 bytes)
+#define HS_MULTI     (CTX_SLOTS / 2) // most 2~4 byte symbols
+
+typedef struct {
+    uint64_t bits;   // code, low aligned
+    int len;         // -1 = symbol not in codebook
+} HsCode;
+
+typedef struct {
+    HsCode byte[256];         // one byte symbols
+    HsCode *multi;            // 2~4 byte symbols
+    CtxEntry *slot;           // symbol bytes -> multi[] (table field)
+    int nmulti;
+    HsCode eof, esc;
+    unsigned char hold[8];    // start of a symbol cut by the chunk end, 0 after nhold
+    int nhold;
+    uint64_t acc;             // bits of an unfinished byte (cnt < 8 between calls)
+    int cnt;
+    int finished;             // EOF code written
+    uint32_t crc;             // crc32c of the bytes taken
+} HsEnc;
+
+typedef struct {
+    const Codebook *cb;
+    int node;                 // tree position, root between symbols
+    int byte, nbits;          // byte being read, bits left in it
+    int esc, esc_bits, esc_val, esc_left; // ESC: 1 = length bits, 2 = raw bytes
+    int done;                 // EOF code seen, rest of that byte is padding
+    int pend, pend_at;        // leaf of a symbol cut by a full out, its bytes written
+    long long count;          // symbols decoded
+    uint32_t crc;             // crc32c of the decoded bytes
+} HsDec;
+
+// ------------------ codes of the codebook tree, 0 = too long / too many symbols -------------------------
+static inline int hs_codes(HsEnc *e, const Codebook *cb, int idx, uint64_t bits, int depth) {
+    if (idx == 0) return 1;
+    const Node *node = &cb->nodes[idx];
+    if (!node->is_leaf) {
+        return depth < HS_MAX_CODE && hs_codes(e, cb, node->left, bits << 1, depth + 1)
+                                   && hs_codes(e, cb, node->right, (bits << 1) | 1, depth + 1);
+    }
+    HsCode c = { bits, depth };
+    if (node->useLen == 3 && memcmp(node->chr, "EOF", 3) == 0) e->eof = c;
+    else if (node->useLen == 3 && memcmp(node->chr, "ESC", 3) == 0) e->esc = c;
+    else if (node->useLen == 1) e->byte[node->chr[0]] = c;
+    else if (node->useLen <= 4) { // longer: merged token, never cut out of a stream
+        CtxEntry *s = ctx_slot(e->slot, node->chr, node->useLen);
+        if (s->len != 0) return 1;
+        if (e->nmulti == HS_MULTI) return 0;
+        memcpy(s->chr, node->chr, node->useLen);
+        s->len = node->useLen;
+        s->table = e->nmulti;
+        e->multi[e->nmulti++] = c;
+    }
+    return 1;
+}
+
+// ------------------ stream encoder of a plain codebook, 0 = codebook not usable -------------------------
+static inline int hs_enc_init(HsEnc *e, const Codebook *cb) {
+    memset(e, 0, sizeof(*e));
+    for (int i = 0; i < 256; i++) e->byte[i].len = -1;
+    e->eof.len = e->esc.len = -1;
+    e->multi = (HsCode*)malloc(HS_MULTI * sizeof(HsCode));
+    e->slot = (CtxEntry*)calloc(CTX_SLOTS, sizeof(CtxEntry));
+    if (e->multi == NULL || e->slot == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+    if (cb->ntables != 1 || cb->lenroot != 0 || cb->ans_log != 0) return 0;
+    return hs_codes(e, cb, cb->roots[0], 0, 0) && e->eof.len >= 0;
+}
+static inline void hs_enc_free(HsEnc *e) {
+    free(e->multi);
+    free(e->slot);
+    e->multi = NULL;
+    e->slot = NULL;
+}
+
+// ------------------ n bits of v (n <= 64) after the pending ones, whole bytes to out -------------------------
+static inline size_t hs_put(HsEnc *e, uint64_t v, int n, unsigned char *out) {
+    size_t w = 0;
+    if (n > 56) { // acc holds at most 7 + 56 bits
+        w = hs_put(e, v >> 32, n - 32, out);
+        v &= 0xFFFFFFFFull;
+        n = 32;
+    }
+    e->acc = (e->acc << n) | v;
+    e->cnt += n;
+    while (e->cnt >= 8) {
+        e->cnt -= 8;
+        out[w++] = (unsigned char)(e->acc >> e->cnt);
+    }
+    e->acc &= (1ull << e->cnt) - 1;
+    return w;
+}
+
+// ------------------ code of one symbol, return bytes written, -1 = not in codebook -------------------------
+static inline long long hs_symbol(HsEnc *e, const unsigned char *p, int len, unsigned char *out) {
+    const HsCode *c = NULL;
+    if (len == 1) c = &e->byte[p[0]];
+    else {
+        CtxEntry *s = ctx_slot(e->slot, p, len);
+        if (s->len != 0) c = &e->multi[s->table];
+    }
+    if (c != NULL && c->len >= 0) return (long long)hs_put(e, c->bits, c->len, out);
+    if (e->esc.len < 0) { fprintf(stderr, "Error: symbol not in codebook.\n"); return -1; }
+    // ESC, 4 bits length - 1, raw bytes (like sampled statistics)
+    size_t w = hs_put(e, e->esc.bits, e->esc.len, out);
+    w += hs_put(e, (uint64_t)(len - 1), 4, out + w);
+    for (int i = 0; i < len; i++) w += hs_put(e, p[i], 8, out + w);
+    return (long long)w;
+}
+// code the first symbol of hold[]
+static inline long long hs_hold(HsEnc *e, unsigned char *out) {
+    int len = scan_mixed(e->hold);
+    long long k = hs_symbol(e, e->hold, len, out);
+    memmove(e->hold, e->hold + len, sizeof(e->hold) - len);
+    memset(e->hold + sizeof(e->hold) - len, 0, len);
+    e->nhold -= len;
+    return k;
+}
+
+// ------------------ code a chunk, return input bytes taken (all unless out is full), -1 = error -------------------------
+// *out_len = bytes written to out
+static inline long long hs_enc_feed(HsEnc *e, const void *in, size_t n, void *out, size_t cap, size_t *out_len) {
+    const unsigned char *p = (const unsigned char*)in;
+    unsigned char *o = (unsigned char*)out;
+    size_t i = 0, w = 0;
+    long long k = 0;
+    *out_len = 0;
+    if (e->finished) return -1;
+    while (cap - w >= HS_ROOM) {
+        if (e->nhold > 0) { // symbol cut by the last chunk end
+            int need = scan_need(e->hold[0]);
+            while (e->nhold < need && i < n) e->hold[e->nhold++] = p[i++];
+            if (e->nhold < need) break; // still cut, wait for more
+            k = hs_hold(e, o + w);
+        } else if (i + 4 <= n) {
+            int len = scan_mixed(p + i);
+            k = hs_symbol(e, p + i, len, o + w);
+            i += len;
+        } else { // chunk end: keep the last bytes, code what they decide
+            while (i < n) e->hold[e->nhold++] = p[i++];
+            if (e->nhold == 0 || e->nhold < scan_need(e->hold[0])) break;
+            k = hs_hold(e, o + w);
+        }
+        if (k < 0) return -1;
+        w += (size_t)k;
+    }
+    e->crc = crc32c(e->crc, p, i);
+    *out_len = w;
+    return (long long)i;
+}
+
+// ------------------ code the held bytes as if input ended here -------------------------
+// return 1 = done, 0 = out full (call again), -1 = error; *out_len = bytes written
+static inline int hs_enc_flush(HsEnc *e, void *out, size_t cap, size_t *out_len) {
+    unsigned char *o = (unsigned char*)out;
+    size_t w = 0;
+    *out_len = 0;
+    while (e->nhold > 0) {
+        if (cap - w < HS_ROOM) { *out_len = w; return 0; }
+        long long k = hs_hold(e, o + w);
+        if (k < 0) return -1;
+        w += (size_t)k;
+    }
+    *out_len = w;
+    return 1;
+}
+// ------------------ flush, then EOF code and the last byte (0 padded) -------------------------
+static inline int hs_enc_finish(HsEnc *e, void *out, size_t cap, size_t *out_len) {
+    unsigned char *o = (unsigned char*)out;
+    int r = hs_enc_flush(e, out, cap, out_len);
+    if (r <= 0 || e->finished) return r;
+    size_t w = *out_len;
+    if (cap - w < HS_ROOM) return 0;
+    w += hs_put(e, e->eof.bits, e->eof.len, o + w);
+    if (e->cnt > 0) o[w++] = (unsigned char)(e->acc << (8 - e->cnt));
+    e->cnt = 0;
+    e->acc = 0;
+    e->finished = 1;
+    *out_len = w;
+    return 1;
+}
+
+// ------------------ stream decoder of a plain codebook, 0 = codebook not usable -------------------------
+static inline int hs_dec_init(HsDec *d, const Codebook *cb) {
+    memset(d, 0, sizeof(*d));
+    d->cb = cb;
+    if (cb->ntables != 1 || cb->lenroot != 0 || cb->ans_log != 0) return 0;
+    d->node = cb->roots[0];
+    if (cb->nodes[d->node].is_leaf) d->done = 1; // empty input: only EOF in table
+    return 1;
+}
+
+// ------------------ decode a chunk, return input bytes taken, -1 = error -------------------------
+// stops at the EOF code (d->done) or when out is full; *out_len = bytes written
+static inline long long hs_dec_feed(HsDec *d, const void *in, size_t n, void *out, size_t cap, size_t *out_len) {
+    const unsigned char *p = (const unsigned char*)in;
+    unsigned char *o = (unsigned char*)out;
+    const Node *nodes = d->cb->nodes;
+    int root = d->cb->roots[0];
+    size_t i = 0, w = 0;
+    if (d->pend) { // rest of the symbol the last call had no room for
+        const Node *c = &nodes[d->pend];
+        size_t k = (size_t)(c->useLen - d->pend_at);
+        if (k > cap) k = cap;
+        memcpy(o, c->chr + d->pend_at, k);
+        w = k;
+        d->pend_at += (int)k;
+        if (d->pend_at == c->useLen) { d->pend = 0; d->count++; }
+    }
+    while (!d->done && w < cap) { // every write below is at most one symbol, cut to the room left
+        if (d->nbits == 0) {
+            if (i == n) break;
+            d->byte = p[i++];
+            d->nbits = 8;
+        }
+        int bit = (d->byte >> --d->nbits) & 1;
+        if (d->esc > 0) { // ESC: 4 bits length - 1, then raw bytes
+            d->esc_val = (d->esc_val << 1) | bit;
+            if (--d->esc_bits > 0) continue;
+            if (d->esc == 1) {
+                d->esc = 2;
+                d->esc_left = d->esc_val + 1;
+            } else {
+                o[w++] = (unsigned char)d->esc_val;
+                if (--d->esc_left == 0) { d->esc = 0; d->count++; }
+            }
+            d->esc_val = 0;
+            d->esc_bits = 8;
+            continue;
+        }
+        int child = bit ? nodes[d->node].right : nodes[d->node].left;
+        if (child == 0) {
+            fprintf(stderr, "Error: Invalid path (code not found in tree).\n");
+            *out_len = w;
+            return -1;
+        }
+        const Node *c = &nodes[child];
+        if (!c->is_leaf) { d->node = child; continue; }
+        d->node = root;
+        if (c->is_leaf == LEAF_EOF) {
+            d->done = 1;
+        } else if (c->is_leaf == LEAF_ESC) {
+            d->esc = 1;
+            d->esc_bits = 4;
+            d->esc_val = 0;
+        } else {
+            size_t k = (size_t)c->useLen;
+            if (k > cap - w) { k = cap - w; d->pend = child; d->pend_at = (int)k; } // rest on the next call
+            else d->count++;
+            memcpy(o + w, c->chr, k);
+            w += k;
+        }
+    }
+    d->crc = crc32c(d->crc, o, w);
+    *out_len = w;
+    return (long long)i;
+}
+
+// ------------------ read what a pipe / socket has now (no waiting for a full block) -------------------------
+// return bytes read, 0 at end of file, -1 on error
+static inline long long hs_read(FILE *fp, void *buf, size_t n) {
+#ifdef _WIN32
+    return (long long)fread(buf, 1, n, fp);
+#else
+    ssize_t k;
+    while ((k = read(fileno(fp), buf, n)) < 0 && errno == EINTR) ;
+    return (long long)k;
+#endif
+}
+
+#endif